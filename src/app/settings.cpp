@@ -130,7 +130,14 @@ void Settings::load() {
     GUI::systemMenu = parser.get<bool>("gui", "systemMenu", true);
 
     OS::numThreads = parser.get<std::uint8_t>("os", "numThreads");
-    OS::queueEntries = parser.get<std::uint8_t>("os", "queueEntries", 128);
+    OS::queueEntries = parser.get<std::uint32_t>("os", "queueEntries", 1024);
+    OS::completionEntries = parser.get<std::uint32_t>("os", "completionEntries", 4096);
+    OS::zeroCopyThreshold = parser.get<std::uint32_t>("os", "zeroCopyThreshold");
+    OS::sqPoll = parser.get<bool>("os", "sqPoll");
+    OS::sqPollIdle = parser.get<std::uint32_t>("os", "sqPollIdle", 1000);
+    OS::sqPollCPU = parser.get<std::int32_t>("os", "sqPollCPU", -1);
+    OS::setupProfile = parser.get<std::uint8_t>("os", "setupProfile");
+    OS::epoll = parser.get<bool>("os", "epoll");
     OS::bluetoothUUIDs = parser.get<std::vector<std::pair<std::string, UUIDs::UUID128>>>("os", "bluetoothUUIDs",
         {
             { "L2CAP", UUIDs::createFromBase(0x0100) },
@@ -188,6 +195,31 @@ void Settings::drawSettingsWindow(bool& open) {
     ImGui::SetNextItemWidth(4_fh);
     ImGuiExt::inputScalar("io_uring queue entries (Linux only)", OS::queueEntries);
 
+    ImGui::SetNextItemWidth(4_fh);
+    ImGuiExt::inputScalar("io_uring completion queue entries (Linux only, 0 for default)", OS::completionEntries);
+
+    ImGui::SetNextItemWidth(4_fh);
+    ImGuiExt::inputScalar("Zero-copy send threshold in KiB (Linux only, 0 to disable)", OS::zeroCopyThreshold);
+
+    ImGui::Checkbox("Submission queue polling (Linux only)", &OS::sqPoll);
+
+    ImGui::BeginDisabled(!OS::sqPoll);
+    ImGui::SetNextItemWidth(4_fh);
+    ImGuiExt::inputScalar("Polling idle time in milliseconds", OS::sqPollIdle);
+
+    ImGui::SetNextItemWidth(4_fh);
+    ImGuiExt::inputScalar("Polling CPU (-1 to not pin)", OS::sqPollCPU);
+    ImGui::EndDisabled();
+
+    // Names in the order of Async::SetupProfile
+    ImGui::TextUnformatted("io_uring setup profile (Linux only):");
+    for (std::uint8_t i = 0; const char* name : { "Default", "Throughput", "Latency" }) {
+        ImGui::SameLine();
+        ImGuiExt::radioButton(name, OS::setupProfile, i++);
+    }
+
+    ImGui::Checkbox("Use epoll instead of io_uring (Linux only)", &OS::epoll);
+
     drawBluetoothUUIDsSettings(OS::bluetoothUUIDs);
 
     // ========================= Actions =========================
@@ -206,6 +238,13 @@ void Settings::drawSettingsWindow(bool& open) {
 
         parser.set("os", "numThreads", OS::numThreads);
         parser.set("os", "queueEntries", OS::queueEntries);
+        parser.set("os", "completionEntries", OS::completionEntries);
+        parser.set("os", "zeroCopyThreshold", OS::zeroCopyThreshold);
+        parser.set("os", "sqPoll", OS::sqPoll);
+        parser.set("os", "sqPollIdle", OS::sqPollIdle);
+        parser.set("os", "sqPollCPU", OS::sqPollCPU);
+        parser.set("os", "setupProfile", OS::setupProfile);
+        parser.set("os", "epoll", OS::epoll);
         parser.set("os", "bluetoothUUIDs", OS::bluetoothUUIDs);
 
         AppCore::configOnNextFrame();
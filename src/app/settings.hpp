@@ -27,7 +27,14 @@ namespace Settings {
 
     namespace OS {
         inline std::uint8_t numThreads;
-        inline std::uint8_t queueEntries;
+        inline std::uint32_t queueEntries;
+        inline std::uint32_t completionEntries;
+        inline std::uint32_t zeroCopyThreshold; // In KiB
+        inline bool sqPoll;
+        inline std::uint32_t sqPollIdle; // In milliseconds
+        inline std::int32_t sqPollCPU;
+        inline std::uint8_t setupProfile; // Index of an Async::SetupProfile
+        inline bool epoll;
         inline std::vector<std::pair<std::string, UUIDs::UUID128>> bluetoothUUIDs;
     }
 
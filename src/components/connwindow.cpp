@@ -3,10 +3,14 @@
 
 #include "connwindow.hpp"
 
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
 #include <format>
 #include <memory>
 #include <string>
 #include <string_view>
+#include <system_error>
 #include <utility>
 
 #include <botan/tls_exceptn.h>
@@ -42,6 +46,9 @@ SocketPtr makeClientSocket(bool useTLS, ConnectionType type) {
 ConnWindow::ConnWindow(std::string_view title, bool useTLS, const Device& device, std::string_view) :
     Window(title), socket(makeClientSocket(useTLS, device.type)) {
     if (Settings::GUI::systemMenu) Menu::addWindowMenuItem(getTitle());
+
+    // Files can't be split into datagrams without losing data
+    console.setCanSendFiles(device.type != ConnectionType::UDP);
     connect(device);
 }
 
@@ -71,33 +78,67 @@ Task<> ConnWindow::sendHandler(std::string s) try {
     console.addError(error.what());
 }
 
+Task<> ConnWindow::sendFile(std::string path) {
+    std::error_code ec;
+    std::uint64_t size = std::filesystem::file_size(path, ec);
+    if (ec) {
+        console.addError(std::format("Could not send {}: {}", path, ec.message()));
+        co_return;
+    }
+
+    console.addInfo(std::format("Sending {} ({} bytes)...", path, size));
+    console.addFileSize(size);
+
+    std::uint64_t numSent = 0;
+    try {
+        co_await socket->sendFile(path, [this, &numSent](std::size_t partSize) {
+            numSent += partSize;
+            console.addFileProgress(partSize);
+        });
+
+        console.addInfo(std::format("Sent {}.", path));
+    } catch (const System::SystemError& error) {
+        console.errorHandler(error);
+    } catch (const Botan::TLS::TLS_Exception& error) {
+        console.addError(error.what());
+    } catch (const std::system_error& error) {
+        console.addError(error.what());
+    }
+
+    // Take the rest of the file out of the progress bar if it wasn't all sent
+    if (numSent < size) console.addFileProgress(size - numSent);
+}
+
 Task<> ConnWindow::readHandler() try {
     if (!connected || pendingRecv) co_return;
     pendingRecv = true;
 
-    auto [complete, closed, data, alert] = co_await socket->recv(console.getRecvSize());
-
-    if (complete) {
-        if (closed) {
-            // Peer closed connection
-            console.addInfo("Remote host closed connection.");
-            socket->close();
-            connected = false;
-        } else {
-            console.addText(data);
+    // Received data is handed over as it arrives, this only returns once the connection is closed
+    co_await socket->recvStream(console.getRecvSize(), [this](RecvResult result) {
+        auto& [complete, closed, data, alert] = result;
+
+        if (complete) {
+            if (closed) {
+                // Peer closed connection
+                console.addInfo("Remote host closed connection.");
+                socket->close();
+                connected = false;
+            } else if (console.captureReceived(data)) {
+                console.addText(data);
+            }
         }
-    }
 
-    if (alert) {
-        std::string desc = "ALERT";
-        ImVec4 color{ 0, 0.6f, 0, 1 };
-        if (alert->isFatal) {
-            console.addMessage(std::format("FATAL: {}", alert->desc), desc, color);
-            connected = false;
-        } else {
-            console.addMessage(alert->desc, desc, color);
+        if (alert) {
+            std::string desc = "ALERT";
+            ImVec4 color{ 0, 0.6f, 0, 1 };
+            if (alert->isFatal) {
+                console.addMessage(std::format("FATAL: {}", alert->desc), desc, color);
+                connected = false;
+            } else {
+                console.addMessage(alert->desc, desc, color);
+            }
         }
-    }
+    });
     pendingRecv = false;
 } catch (const System::SystemError& error) {
     console.errorHandler(error);
@@ -114,4 +155,5 @@ void ConnWindow::onBeforeUpdate() {
 
 void ConnWindow::onUpdate() {
     if (auto sendString = console.updateWithTextbox()) sendHandler(*sendString);
+    if (auto path = console.takeFileToSend()) sendFile(*path);
 }
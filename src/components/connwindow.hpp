@@ -25,7 +25,10 @@ class ConnWindow : public Window {
     // Sends a string through the socket.
     Task<> sendHandler(std::string s);
 
-    // Receives a string from the socket and displays it in the console output.
+    // Sends a file through the socket, showing its progress in the console.
+    Task<> sendFile(std::string path);
+
+    // Receives strings from the socket and displays them in the console output until the connection is closed.
     Task<> readHandler();
 
     // Handles incoming I/O.
@@ -4,6 +4,7 @@
 #include "ioconsole.hpp"
 
 #include <array>
+#include <format>
 #include <optional>
 #include <string>
 
@@ -32,6 +33,21 @@ void IOConsole::drawControls() {
             else recvSize = recvSizeTmp;
         }
 
+        // Files are sent through the same connections as the textbox input
+        if (canSendFiles) {
+            ImGui::Separator();
+            ImGui::SetNextItemWidth(12_fh);
+            ImGuiExt::inputText("File path", filePathBuf);
+
+            ImGui::BeginDisabled(filePathBuf.empty());
+            if (ImGui::Button("Send file")) {
+                fileToSend = filePathBuf;
+                ImGui::CloseCurrentPopup();
+            }
+            ImGui::EndDisabled();
+        }
+
+        drawCaptureControls();
         ImGui::EndPopup();
     }
 
@@ -47,6 +63,44 @@ void IOConsole::drawControls() {
     ImGui::Combo("##lineEnding", &currentLE, "Newline\0Carriage return\0Both\0");
 }
 
+void IOConsole::drawCaptureControls() {
+    using namespace ImGuiExt::Literals;
+
+    ImGui::Separator();
+    if (!capture) {
+        ImGui::SetNextItemWidth(12_fh);
+        ImGuiExt::inputText("Capture path", capturePathBuf);
+
+        ImGui::BeginDisabled(capturePathBuf.empty());
+        if (ImGui::Button("Start capture")) {
+            try {
+                capture.emplace(capturePathBuf);
+                addInfo(std::format("Capturing received data to {}.", capturePathBuf));
+            } catch (const System::SystemError& error) {
+                errorHandler(error);
+            }
+
+            ImGui::CloseCurrentPopup();
+        }
+        ImGui::EndDisabled();
+        return;
+    }
+
+    ImGuiExt::textUnformatted(std::format("Captured {} bytes", capture->getNumWritten()));
+    if (capture->getNumDropped() > 0) {
+        ImGui::SameLine();
+        ImGuiExt::textUnformatted(std::format("({} bytes dropped)", capture->getNumDropped()));
+    }
+
+    ImGui::MenuItem("Show captured data", nullptr, &showCaptured);
+
+    // Data that is still waiting is written after the capture is stopped
+    if (ImGui::Button("Stop capture")) {
+        addInfo(std::format("Stopped capturing to {}.", capturePathBuf));
+        capture.reset();
+    }
+}
+
 std::optional<std::string> IOConsole::updateWithTextbox() {
     std::optional<std::string> ret;
 
@@ -89,6 +143,20 @@ std::optional<std::string> IOConsole::updateWithTextbox() {
         focusOnTextbox = true;
     }
 
+    // Stop capturing if writing to the file failed
+    if (capture && capture->getError()) {
+        addError(std::format("Capture stopped: {}", *capture->getError()));
+        capture.reset();
+    }
+
+    // Progress of files being sent
+    if (fileBytesTotal > 0) {
+        float fraction = static_cast<float>(fileBytesSent) / static_cast<float>(fileBytesTotal);
+        std::string overlay = std::format("Sending file: {} / {} bytes", fileBytesSent, fileBytesTotal);
+
+        ImGui::ProgressBar(fraction, { ImGuiExt::fill, 0 }, overlay.c_str());
+    }
+
     update("console");
     drawControls();
 
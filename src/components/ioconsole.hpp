@@ -3,19 +3,29 @@
 
 #pragma once
 
+#include <cstdint>
 #include <optional>
 #include <string>
+#include <string_view>
+#include <utility>
 
 #include <imgui.h>
 
 #include "console.hpp"
 #include "os/error.hpp"
+#include "os/filewriter.hpp"
 
 // Manages a textbox and console with config options.
 class IOConsole : public Console {
     // State
     bool focusOnTextbox = false; // If keyboard focus is applied to the textbox
     std::string textBuf; // Send textbox buffer
+    std::string filePathBuf; // File path textbox buffer
+    std::optional<std::string> fileToSend; // File path submitted and not yet taken
+    std::uint64_t fileBytesSent = 0; // Bytes sent from files being sent
+    std::uint64_t fileBytesTotal = 0; // Total size of files being sent
+    std::string capturePathBuf; // Capture file path textbox buffer
+    std::optional<FileWriter> capture; // File that received data is written to
 
     // Options
     int currentLE = 0; // Index of the line ending selected
@@ -24,9 +34,14 @@ class IOConsole : public Console {
     bool addFinalLineEnding = false; // If a final line ending is added to the callback input string
     unsigned int recvSize = 1024; // Unsigned int to work with ImGuiDataType
     unsigned int recvSizeTmp = 1024; // Temporary buffer to hold input
+    bool canSendFiles = true; // If the option to send files is shown
+    bool showCaptured = true; // If captured data is also shown in the output
 
     void drawControls();
 
+    // Draws the options to capture received data to a file.
+    void drawCaptureControls();
+
 public:
     // Draws the window contents and returns text entered into the textbox when Enter is pressed.
     std::optional<std::string> updateWithTextbox();
@@ -35,6 +50,34 @@ public:
         return recvSize;
     }
 
+    void setCanSendFiles(bool enabled) {
+        canSendFiles = enabled;
+    }
+
+    // Gets the path of a file the user chose to send, if there is one.
+    std::optional<std::string> takeFileToSend() {
+        return std::exchange(fileToSend, std::nullopt);
+    }
+
+    // Adds to the total size of files being sent, shown in a progress bar until the bytes are reported as sent.
+    void addFileSize(std::uint64_t size) {
+        fileBytesTotal += size;
+    }
+
+    // Reports bytes sent (or given up on) from files. The progress bar is hidden once all bytes are reported.
+    void addFileProgress(std::uint64_t size) {
+        fileBytesSent += size;
+        if (fileBytesSent >= fileBytesTotal) fileBytesSent = fileBytesTotal = 0;
+    }
+
+    // Writes received data to the capture file if one is open. Returns if the data should also be shown in the output.
+    bool captureReceived(std::string_view data) {
+        if (!capture) return true;
+
+        capture->write(data);
+        return showCaptured;
+    }
+
     // Prints the details of a thrown exception.
     void errorHandler(System::SystemError error);
 };
@@ -3,11 +3,19 @@
 
 #include "serverwindow.hpp"
 
+#include <algorithm>
 #include <array>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
 #include <format>
 #include <memory>
+#include <optional>
+#include <stop_token>
 #include <string>
 #include <string_view>
+#include <system_error>
+#include <vector>
 
 #include <imgui.h>
 #include <imgui_internal.h>
@@ -17,8 +25,10 @@
 #include "gui/menu.hpp"
 #include "net/enums.hpp"
 #include "os/error.hpp"
+#include "sockets/clientsocket.hpp"
 #include "sockets/delegates/delegates.hpp"
 #include "sockets/serversocket.hpp"
+#include "utils/combinators.hpp"
 
 // Colors to display each client in
 const std::array colors{
@@ -45,25 +55,122 @@ Task<> ServerWindow::Client::recv(IOConsole& serverConsole, const Device& device
     if (!connected || pendingRecv) co_return;
     pendingRecv = true;
 
-    auto recvResult = co_await socket->recv(size);
+    // Received data is handed over as it arrives, this only returns once the connection is closed
+    co_await socket->recvStream(size, [this, &serverConsole, &device](RecvResult recvResult) {
+        if (recvResult.closed) {
+            serverConsole.addInfo(std::format("{} closed connection.", formatDevice(device)));
+            console.addInfo("Client closed connection.");
+            socket->close();
+            connected = selected = false;
+        } else if (serverConsole.captureReceived(recvResult.data)) {
+            serverConsole.addText(recvResult.data, "", colors[colorIndex], true, formatDevice(device));
+            console.addText(recvResult.data);
+        }
+    });
+    pendingRecv = false;
+} catch (const System::SystemError& error) {
+    serverConsole.errorHandler(error);
+}
 
-    if (recvResult.closed) {
-        serverConsole.addInfo(std::format("{} closed connection.", formatDevice(device)));
-        console.addInfo("Client closed connection.");
+Task<> ServerWindow::Client::relay(IOConsole& serverConsole, const Device& device, RelayInfo relayInfo) {
+    if (!connected || pendingRecv) co_return;
+    pendingRecv = true;
+
+    // A stop is requested when the client is destroyed, its coroutines then return without touching it. The token is
+    // kept in the frame so it can still be checked after that.
+    std::stop_token stopToken = relayStop.get_token();
+
+    try {
+        upstream = std::make_unique<ClientSocketIP>();
+        co_await upstream->connect(relayInfo.upstream);
+    } catch (const System::SystemError& error) {
+        if (stopToken.stop_requested()) co_return;
+
+        serverConsole.errorHandler(error);
         socket->close();
         connected = selected = false;
-    } else {
-        serverConsole.addText(recvResult.data, "", colors[colorIndex], true, formatDevice(device));
-        console.addText(recvResult.data);
+        pendingRecv = false;
+        co_return;
+    }
+
+    if (stopToken.stop_requested()) co_return;
+
+    serverConsole.addInfo(std::format("Relaying {} to {} port {}.", formatDevice(device), relayInfo.upstream.address,
+        relayInfo.upstream.port));
+
+    // The directions end separately, each one passes the end of its data on to the other connection
+    numRelaying = 2;
+    relayOneWay(serverConsole, device, true, relayInfo.sampleSize);
+    relayOneWay(serverConsole, device, false, relayInfo.sampleSize);
+}
+
+Task<> ServerWindow::Client::relayOneWay(IOConsole& serverConsole, const Device& device, bool fromClient,
+    unsigned int sampleSize) {
+    const Socket& source = fromClient ? *socket : *upstream;
+    const Socket& target = fromClient ? *upstream : *socket;
+    std::stop_token stopToken = relayStop.get_token(); // See relay()
+    std::stop_token endToken = relayEnd.get_token();
+
+    // Samples are marked with the direction they were relayed in
+    auto onRelay = [this, &serverConsole, &device, pre = fromClient ? "> " : "< "](std::size_t, std::string sample) {
+        if (sample.empty()) return;
+
+        serverConsole.addText(sample, pre, colors[colorIndex], true, formatDevice(device));
+        console.addText(sample, pre);
+    };
+
+    try {
+        co_await source.relay(target, sampleSize, onRelay, endToken);
+    } catch (const System::SystemError& error) {
+        // If this direction failed, the other one is stopped too since it could otherwise wait on its live connection
+        // forever. It only gets a cancellation, which isn't shown.
+        if (!endToken.stop_requested()) {
+            serverConsole.errorHandler(error);
+            relayEnd.request_stop();
+        }
     }
+
+    if (stopToken.stop_requested() || --numRelaying > 0) co_return;
+
+    serverConsole.addInfo(std::format("Relay for {} closed.", formatDevice(device)));
+    socket->close();
+    upstream->close();
+    connected = selected = false;
     pendingRecv = false;
-} catch (const System::SystemError& error) {
-    serverConsole.errorHandler(error);
 }
 
-ServerWindow::ServerWindow(std::string_view title, const Device& serverInfo) :
-    Window(title), socket(makeServerSocket(serverInfo.type)), isDgram(serverInfo.type == ConnectionType::UDP) {
+Task<> ServerWindow::Client::sendFile(IOConsole& serverConsole, const Device& device, std::string path,
+    std::uint64_t size) {
+    std::uint64_t numSent = 0;
+    try {
+        co_await socket->sendFile(path, [&serverConsole, &numSent](std::size_t partSize) {
+            numSent += partSize;
+            serverConsole.addFileProgress(partSize);
+        });
+
+        console.addInfo(std::format("Sent {}.", path));
+    } catch (const System::SystemError& error) {
+        serverConsole.errorHandler(error);
+    } catch (const std::system_error& error) {
+        serverConsole.addError(std::format("{}: {}", formatDevice(device), error.what()));
+    }
+
+    // Take the rest of the file out of the progress bar if it wasn't all sent
+    if (numSent < size) serverConsole.addFileProgress(size - numSent);
+}
+
+ServerWindow::ServerWindow(std::string_view title, const Device& serverInfo,
+    const std::optional<RelayInfo>& relayInfo) :
+    Window(title),
+    socket(makeServerSocket(serverInfo.type)), isDgram(serverInfo.type == ConnectionType::UDP), relayInfo(relayInfo) {
     startServer(serverInfo);
+    if (relayInfo) {
+        console.addInfo(std::format("Relaying clients to {} port {}.", relayInfo->upstream.address,
+            relayInfo->upstream.port));
+    }
+
+    // Files can't be split into datagrams without losing data
+    console.setCanSendFiles(!isDgram);
     clientsWindowTitle = std::format("Clients: {}", getTitle());
 
     using namespace ImGuiExt::Literals;
@@ -120,22 +227,24 @@ Task<> ServerWindow::accept() try {
     if (!socket->isValid() || pendingIO) co_return;
     pendingIO = true;
 
-    auto [device, clientSocket] = co_await socket->accept();
+    // Clients are handed over as they are accepted, this only returns if accepting fails
+    co_await socket->acceptStream([this](AcceptResult result) {
+        auto& [device, clientSocket] = result;
 
-    std::string message = device.name.empty()
-        ? std::format("Accepted connection from {} on port {}.", device.address, device.port)
-        : std::format("Accepted connection from {} ({}) on port {}.", device.name, device.address, device.port);
+        std::string message = device.name.empty()
+            ? std::format("Accepted connection from {} on port {}.", device.address, device.port)
+            : std::format("Accepted connection from {} ({}) on port {}.", device.name, device.address, device.port);
 
-    console.addInfo(message);
+        console.addInfo(message);
 
-    auto [it, didEmplace] = clients.try_emplace(device, std::move(clientSocket), colorIndex);
-    if (didEmplace) {
-        nextColor();
-    } else {
-        it->second.socket = std::move(clientSocket);
-        it->second.connected = it->second.selected = true;
-    }
-    pendingIO = false;
+        auto [it, didEmplace] = clients.try_emplace(device, std::move(clientSocket), colorIndex);
+        if (didEmplace) {
+            nextColor();
+        } else {
+            it->second.socket = std::move(clientSocket);
+            it->second.connected = it->second.selected = true;
+        }
+    });
 } catch (const System::SystemError& error) {
     console.errorHandler(error);
 }
@@ -144,18 +253,60 @@ Task<> ServerWindow::recvDgram() try {
     if (!socket->isValid() || pendingIO) co_return;
     pendingIO = true;
 
-    auto [device, data] = co_await socket->recvFrom(console.getRecvSize());
+    // Datagrams are handed over in batches as they are received, this only returns if receiving fails
+    co_await socket->recvFromStream(console.getRecvSize(), [this](DgramRecvResult result) {
+        auto& [device, data] = result;
 
-    auto [it, didEmplace] = clients.try_emplace(device, nullptr, colorIndex);
-    if (didEmplace) nextColor(); // Advance colors if there is data received from a new client
+        auto [it, didEmplace] = clients.try_emplace(device, nullptr, colorIndex);
+        if (didEmplace) nextColor(); // Advance colors if there is data received from a new client
 
-    console.addText(data, "", colors[it->second.colorIndex], true, formatDevice(device));
-    it->second.console.addText(data);
-    pendingIO = false;
+        if (console.captureReceived(data)) {
+            console.addText(data, "", colors[it->second.colorIndex], true, formatDevice(device));
+            it->second.console.addText(data);
+        }
+    });
 } catch (const System::SystemError& error) {
     console.errorHandler(error);
 }
 
+LazyTask<> ServerWindow::sendToClient(Device device, const Client& client, std::string_view data) try {
+    if (isDgram) co_await socket->sendTo(device, data);
+    else co_await client.socket->send(data);
+} catch (const System::SystemError& error) {
+    console.errorHandler(error);
+}
+
+Task<> ServerWindow::sendToClients(std::string data) {
+    std::vector<LazyTask<>> sends;
+    for (const auto& [key, client] : clients) {
+        if (client.selected && (isDgram || client.connected)) sends.push_back(sendToClient(key, client, data));
+    }
+
+    // The sends run concurrently, the data is kept alive until the last one finishes
+    co_await whenAll(std::move(sends));
+}
+
+void ServerWindow::sendFile(const std::string& path) {
+    std::error_code ec;
+    std::uint64_t size = std::filesystem::file_size(path, ec);
+    if (ec) {
+        console.addError(std::format("Could not send {}: {}", path, ec.message()));
+        return;
+    }
+
+    auto isTarget = [](const auto& client) { return client.second.selected && client.second.connected; };
+    auto numClients = std::ranges::count_if(clients, isTarget);
+    console.addInfo(std::format("Sending {} ({} bytes) to {} client(s)...", path, size, numClients));
+
+    // Each client is sent its own copy of the file, all of them are counted in the progress bar
+    for (auto& i : clients) {
+        if (!isTarget(i)) continue;
+
+        console.addFileSize(size);
+        i.second.sendFile(console, i.first, path, size);
+    }
+}
+
 void ServerWindow::nextColor() {
     colorIndex = (colorIndex + 1) % colors.size();
 }
@@ -202,7 +353,10 @@ void ServerWindow::onBeforeUpdate() {
         recvDgram();
     } else {
         accept();
-        for (auto& client : clients) client.second.recv(console, client.first, console.getRecvSize());
+        for (auto& [key, client] : clients) {
+            if (relayInfo) client.relay(console, key, *relayInfo);
+            else client.recv(console, key, console.getRecvSize());
+        }
     }
 
     // Draw opened client windows
@@ -220,12 +374,7 @@ void ServerWindow::onBeforeUpdate() {
 
 void ServerWindow::onUpdate() {
     // Send data to all clients
-    if (auto s = console.updateWithTextbox()) {
-        for (const auto& [key, client] : clients) {
-            if (client.selected) {
-                if (isDgram) socket->sendTo(key, *s);
-                else if (client.connected) client.socket->send(*s);
-            }
-        }
-    }
+    if (auto s = console.updateWithTextbox()) sendToClients(*s);
+
+    if (auto path = console.takeFileToSend()) sendFile(*path);
 }
@@ -3,8 +3,12 @@
 
 #pragma once
 
+#include <cstdint>
 #include <map>
+#include <optional>
+#include <stop_token>
 #include <string>
+#include <string_view>
 
 #include "console.hpp"
 #include "ioconsole.hpp"
@@ -14,6 +18,12 @@
 #include "sockets/socket.hpp"
 #include "utils/task.hpp"
 
+// Server that a relay server forwards its clients to.
+struct RelayInfo {
+    Device upstream;
+    unsigned int sampleSize; // Bytes shown from the start of each part of relayed data
+};
+
 // Handles a server socket in a GUI window.
 class ServerWindow : public Window {
     // Connection-oriented client.
@@ -26,14 +36,31 @@ class ServerWindow : public Window {
         bool remove = false;
         bool pendingRecv = false;
         bool connected = true;
+        SocketPtr upstream; // Connection to the upstream server if the client is relayed
+        std::stop_source relayStop; // Stopped when the client is destroyed
+        std::stop_source relayEnd; // Stops both directions of the relay once one of them fails
+        int numRelaying = 0; // Directions of the relay that are still forwarding data
 
         Client(SocketPtr&& socket, int colorIndex) : socket(std::move(socket)), colorIndex(colorIndex) {}
 
         ~Client() {
             if (socket) socket->cancelIO();
+            if (upstream) upstream->cancelIO();
+            relayStop.request_stop();
+            relayEnd.request_stop();
         }
 
         Task<> recv(IOConsole& serverConsole, const Device& device, unsigned int size);
+
+        // Connects to the upstream server, then forwards data between it and the client until both connections are
+        // closed.
+        Task<> relay(IOConsole& serverConsole, const Device& device, RelayInfo relayInfo);
+
+        // Forwards data in one direction of a relay, showing samples of it in the consoles.
+        Task<> relayOneWay(IOConsole& serverConsole, const Device& device, bool fromClient, unsigned int sampleSize);
+
+        // Sends a file to the client, showing its progress in the server console.
+        Task<> sendFile(IOConsole& serverConsole, const Device& device, std::string path, std::uint64_t size);
     };
 
     // Device comparator functor for std::map. Using a struct to avoid -Wsubobject-linkage on GCC.
@@ -46,6 +73,7 @@ class ServerWindow : public Window {
     SocketPtr socket;
     std::map<Device, Client, CompDevices> clients;
     bool isDgram;
+    std::optional<RelayInfo> relayInfo;
 
     bool pendingIO = false;
     int colorIndex = 0;
@@ -55,12 +83,21 @@ class ServerWindow : public Window {
 
     void startServer(const Device& serverInfo);
 
-    // Accepts connection-oriented clients.
+    // Accepts connection-oriented clients until the server is closed.
     Task<> accept();
 
     // Receives from datagram-oriented clients.
     Task<> recvDgram();
 
+    // Sends data to a client, reporting errors in the console. Started by sendToClients.
+    LazyTask<> sendToClient(Device device, const Client& client, std::string_view data);
+
+    // Sends data to the selected clients and waits for all of them.
+    Task<> sendToClients(std::string data);
+
+    // Sends a file to the selected clients.
+    void sendFile(const std::string& path);
+
     // Selects the next color to display clients in.
     void nextColor();
 
@@ -72,7 +109,8 @@ class ServerWindow : public Window {
     void onUpdate() override;
 
 public:
-    explicit ServerWindow(std::string_view title, const Device& serverInfo);
+    explicit ServerWindow(std::string_view title, const Device& serverInfo,
+        const std::optional<RelayInfo>& relayInfo = std::nullopt);
 
     ~ServerWindow() override;
 };
@@ -3,6 +3,8 @@
 
 #include "newserver.hpp"
 
+#include <optional>
+
 #include <imgui.h>
 
 #include "imguiext.hpp"
@@ -45,8 +47,36 @@ void drawNewServerWindow(WindowList& servers, bool& open) {
     ImGuiExt::radioButton("RFCOMM", serverInfo.type, RFCOMM);
     if constexpr (!OS_WINDOWS) ImGuiExt::radioButton("L2CAP", serverInfo.type, L2CAP);
 
+    // TCP servers can forward their clients to another server
+    static bool relay = false;
+    static Device upstream{ TCP, "", "", 0 };
+    static unsigned int sampleSize = 64;
+
+    if (serverInfo.type == TCP) {
+        ImGui::Checkbox("Relay to upstream server", &relay);
+
+        if (relay) {
+            ImGui::SetNextItemWidth(15_fh);
+            ImGuiExt::inputText("Upstream address", upstream.address);
+
+            ImGui::SameLine();
+            ImGui::SetNextItemWidth(7_fh);
+            ImGuiExt::inputScalar("Upstream port", upstream.port, 1, 10);
+
+            ImGui::SetNextItemWidth(7_fh);
+            ImGuiExt::inputScalar("Sample size", sampleSize, 1, 10);
+            ImGui::SameLine();
+            ImGuiExt::helpMarker("Number of bytes shown from the start of each part of relayed data (0 to show none)");
+        }
+    }
+
     // Cannot check the result of add since server titles are generated dynamically.
-    if (ImGui::Button("Create Server")) servers.add<ServerWindow>("", serverInfo);
+    if (ImGui::Button("Create Server")) {
+        std::optional<RelayInfo> relayInfo;
+        if (relay && serverInfo.type == TCP) relayInfo = RelayInfo{ upstream, sampleSize };
+
+        servers.add<ServerWindow>("", serverInfo, relayInfo);
+    }
 
     ImGui::End();
 }
@@ -1,6 +1,8 @@
 // Copyright 2021-2024 Aidan Sun and the WhaleConnect contributors
 // SPDX-License-Identifier: GPL-3.0-or-later
 
+#include <csignal>
+#include <cstddef>
 #include <optional>
 #include <system_error>
 
@@ -61,9 +63,24 @@ int main(int, char**)
 
     using namespace std::literals;
 
+#if OS_LINUX
+    // Sockets closed by their peers fail sends and relays with EPIPE instead of terminating the app (see Async::init)
+    std::signal(SIGPIPE, SIG_IGN);
+#endif
+
     // Initialize APIs for sockets and Bluetooth
     try {
-        Async::init(Settings::OS::numThreads, Settings::OS::queueEntries);
+        Async::init({
+            .numThreads = Settings::OS::numThreads,
+            .queueEntries = Settings::OS::queueEntries,
+            .completionEntries = Settings::OS::completionEntries,
+            .zeroCopyThreshold = std::size_t{ Settings::OS::zeroCopyThreshold } * 1024,
+            .sqPoll = Settings::OS::sqPoll,
+            .sqPollIdle = Settings::OS::sqPollIdle,
+            .sqPollCPU = Settings::OS::sqPollCPU,
+            .setupProfile = static_cast<Async::SetupProfile>(Settings::OS::setupProfile),
+            .backend = Settings::OS::epoll ? Async::Backend::Epoll : Async::Backend::IOUring,
+        });
         btutilsInstance.emplace();
     } catch (const System::SystemError& error) {
         ImGuiExt::addNotification("Initialization error "s + error.what(), NotificationType::Error, 0);
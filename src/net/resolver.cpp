@@ -0,0 +1,88 @@
+// Copyright 2021-2024 Aidan Sun and the WhaleConnect contributors
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "resolver.hpp"
+
+#include <chrono>
+#include <exception>
+#include <map>
+#include <mutex>
+#include <optional>
+
+#include "os/async.hpp"
+#include "os/error.hpp"
+
+// Checks if a lookup failed because the name doesn't exist or has no addresses. Other failures (e.g., a DNS server that
+// couldn't be reached) may be temporary, so they aren't cached.
+bool isNameNotFound(const System::SystemError& error) {
+    if (error.type != System::ErrorType::AddrInfo) return false;
+
+#ifdef EAI_NODATA
+    if (error.code == EAI_NODATA) return true;
+#endif
+
+    return error.code == EAI_NONAME;
+}
+
+void Resolver::store(const Key& key, const SharedAddrInfo& addr, std::exception_ptr error) {
+    auto now = std::chrono::steady_clock::now();
+    auto expiry = now + (error ? negativeTtl : ttl);
+
+    std::scoped_lock lock{ cacheMutex };
+    if (cache.size() >= maxEntries) {
+        std::erase_if(cache, [now](const auto& i) { return i.second.expiry <= now; });
+        if (cache.size() >= maxEntries) cache.clear();
+    }
+
+    cache.insert_or_assign(key, Entry{ addr, error, expiry });
+}
+
+Task<SharedAddrInfo> Resolver::resolve(Device device, bool useDNS) {
+    Key key{ device.address, device.port, device.type, useDNS };
+
+    std::optional<Entry> cached;
+    {
+        std::scoped_lock lock{ cacheMutex };
+        if (auto it = cache.find(key); it != cache.end()) {
+            if (it->second.expiry > std::chrono::steady_clock::now()) cached = it->second;
+            else cache.erase(it);
+        }
+    }
+
+    if (cached) {
+        if (cached->error) std::rethrow_exception(cached->error);
+        co_return cached->addr;
+    }
+
+    // Only names that don't exist are cached as failures, other exceptions are passed on
+    SharedAddrInfo addr;
+    std::exception_ptr error;
+    bool cacheable = true;
+    auto resolveDevice = [&] {
+        try {
+            addr = lookup(device, useDNS);
+        } catch (const System::SystemError& e) {
+            error = std::current_exception();
+            cacheable = isNameNotFound(e);
+        }
+    };
+
+    // Numeric addresses are parsed without any lookups that could block
+    if (useDNS) co_await Async::runBlocking(resolveDevice);
+    else resolveDevice();
+
+    if (cacheable) store(key, addr, error);
+
+    if (error) std::rethrow_exception(error);
+    co_return addr;
+}
+
+void Resolver::clear() {
+    std::scoped_lock lock{ cacheMutex };
+    cache.clear();
+}
+
+Task<SharedAddrInfo> NetUtils::resolveAddrAsync(const Device& device, bool useDNS) {
+    static Resolver resolver;
+    return resolver.resolve(device, useDNS);
+}
@@ -0,0 +1,71 @@
+// Copyright 2021-2024 Aidan Sun and the WhaleConnect contributors
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <tuple>
+
+#include "device.hpp"
+#include "enums.hpp"
+#include "netutils.hpp"
+#include "utils/task.hpp"
+
+// A getaddrinfo result shared between the cache and its users.
+using SharedAddrInfo = std::shared_ptr<const AddrInfoType>;
+
+// Resolves addresses without blocking the event loops, caching the results.
+//
+// Lookups that may query DNS run on a separate thread (see Async::runBlocking). Numeric addresses are resolved in
+// place. getaddrinfo does not report the records' TTLs, so results are kept for a fixed time, and names that don't
+// exist are kept for a shorter time so they are not looked up repeatedly. Other failures aren't cached.
+class Resolver {
+public:
+    // Function that resolves an address, throwing a System::SystemError on failure.
+    using Lookup = std::function<AddrInfoHandle(const Device& device, bool useDNS)>;
+
+private:
+    // Host, port, connection type, and whether DNS is used
+    using Key = std::tuple<std::string, std::uint16_t, ConnectionType, bool>;
+
+    struct Entry {
+        SharedAddrInfo addr; // Null if the lookup failed
+        std::exception_ptr error;
+        std::chrono::steady_clock::time_point expiry;
+    };
+
+    static constexpr std::size_t maxEntries = 1024;
+
+    Lookup lookup;
+    std::chrono::milliseconds ttl;
+    std::chrono::milliseconds negativeTtl;
+    std::map<Key, Entry> cache;
+    std::mutex cacheMutex;
+
+    // Adds a result to the cache, making room for it by removing expired entries (or all of them) if it is full.
+    void store(const Key& key, const SharedAddrInfo& addr, std::exception_ptr error);
+
+public:
+    explicit Resolver(Lookup lookup = NetUtils::resolveAddr, std::chrono::milliseconds ttl = std::chrono::seconds{ 60 },
+        std::chrono::milliseconds negativeTtl = std::chrono::seconds{ 5 }) :
+        lookup(std::move(lookup)), ttl(ttl), negativeTtl(negativeTtl) {}
+
+    // Resolves an address, or gets it from the cache. The coroutine is resumed on the thread it was started on.
+    Task<SharedAddrInfo> resolve(Device device, bool useDNS = true);
+
+    // Removes all cached results.
+    void clear();
+};
+
+namespace NetUtils {
+    // Resolves an address through the shared resolver.
+    Task<SharedAddrInfo> resolveAddrAsync(const Device& device, bool useDNS = true);
+}
@@ -3,20 +3,38 @@
 
 #include "async.hpp"
 
+#include <algorithm>
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <coroutine>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <exception>
 #include <forward_list>
 #include <functional>
+#include <latch>
 #include <memory>
 #include <mutex>
 #include <optional>
+#include <stop_token>
+#include <string_view>
 #include <thread>
+#include <variant>
 #include <vector>
 
 #include "utils/task.hpp"
 
+// Longest time an event loop waits for I/O at once
+// Threads need to handle work that doesn't come through their event loops. On Windows, the completion port is shared
+// between threads and can't be interrupted for a specific one, so waits are kept shorter.
+constexpr std::chrono::milliseconds maxWaitTime{ OS_WINDOWS ? 20 : 200 };
+
+thread_local Async::EventLoop* threadEventLoop = nullptr; // The event loop running on the current thread
+
 class WorkerThread {
-    unsigned int queueEntries;
+    Async::Config config;
 
     std::vector<std::coroutine_handle<>> workQueue;
     std::mutex queueMutex;
@@ -25,6 +43,7 @@ class WorkerThread {
     std::atomic_bool shouldStop = false;
 
     std::unique_ptr<Async::EventLoop> eventLoop;
+    std::latch loopReady{ 1 };
     std::thread thread;
     std::thread::id id;
 
@@ -34,11 +53,15 @@ class WorkerThread {
         shouldStop.store(true, std::memory_order_relaxed);
         hasWork.store(true, std::memory_order_relaxed);
         hasWork.notify_one();
+        eventLoop->interrupt();
     }
 
 public:
-    WorkerThread(unsigned int queueEntries) :
-        queueEntries(queueEntries), thread(&WorkerThread::loop, this), id(thread.get_id()) {}
+    WorkerThread(const Async::Config& config) :
+        config(config), thread(&WorkerThread::loop, this), id(thread.get_id()) {
+        // Wait for the event loop to be created so other threads can interrupt it
+        loopReady.wait();
+    }
 
     ~WorkerThread() {
         stop();
@@ -53,12 +76,18 @@ public:
         numWork.fetch_add(1, std::memory_order_relaxed);
         hasWork.store(true, std::memory_order_relaxed);
         hasWork.notify_one();
+
+        // Wake up the thread if it is waiting for I/O
+        eventLoop->interrupt();
     }
 
     void pushIO(const Async::Operation& operation) {
         eventLoop->push(operation);
         hasWork.store(true, std::memory_order_relaxed);
         hasWork.notify_one();
+
+        // Wake up the thread if the operation came from another thread while it is waiting for I/O
+        if (std::this_thread::get_id() != id) eventLoop->interrupt();
     }
 
     std::size_t size() const {
@@ -74,24 +103,21 @@ void WorkerThread::loop() {
     // Initialize event loop on this thread (needed for single issuer optimization on Linux)
     // numThreads in an event loop constructor is only used on Windows, and only with the first instantiation.
     // Since the main event loop is initialized first, 0 is passed here to avoid storing another value in this class.
-    eventLoop = std::make_unique<Async::EventLoop>(0, queueEntries);
+    eventLoop = std::make_unique<Async::EventLoop>(0, config);
+    threadEventLoop = eventLoop.get();
+    loopReady.count_down();
 
     while (true) {
-        bool expected = true;
-        if (!hasWork.compare_exchange_weak(expected, false, std::memory_order_relaxed)) {
-            if (eventLoop->size() == 0) {
-                // Make thread idle to save CPU cycles
-                hasWork.wait(false, std::memory_order_relaxed);
-            } else {
-                // There are outstanding I/O events, check back periodically
-                using namespace std::literals;
-                std::this_thread::sleep_for(200ms);
-            }
-        }
+        // Make thread idle to save CPU cycles
+        if (eventLoop->size() == 0) hasWork.wait(false, std::memory_order_relaxed);
 
         if (shouldStop.load(std::memory_order_relaxed)) break;
 
-        eventLoop->runOnce();
+        // If there is no pushed work, wait in the event loop until an I/O operation completes
+        // Work pushed during the wait interrupts it so the thread can respond immediately.
+        bool expected = true;
+        bool workPushed = hasWork.compare_exchange_strong(expected, false, std::memory_order_relaxed);
+        eventLoop->runOnce(!workPushed);
 
         // Swap the work queue with an empty queue. This performs the following actions:
         //   - Clears the work queue
@@ -111,9 +137,57 @@ void WorkerThread::loop() {
     }
 }
 
+// Threads that run blocking functions for coroutines. Threads are started as they are needed, up to a limit.
+class BlockingPool {
+    static constexpr std::size_t maxThreads = 4;
+
+    std::deque<std::function<void()>> calls;
+    std::mutex mutex;
+    std::condition_variable_any callAdded;
+    std::size_t numIdle = 0;
+    std::vector<std::jthread> threads;
+
+    void loop(std::stop_token stopToken) {
+        std::unique_lock lock{ mutex };
+
+        while (true) {
+            numIdle++;
+            bool hasCall = callAdded.wait(lock, stopToken, [this] { return !calls.empty(); });
+            numIdle--;
+
+            if (!hasCall) return;
+
+            auto call = std::move(calls.front());
+            calls.pop_front();
+
+            lock.unlock();
+            call();
+            lock.lock();
+        }
+    }
+
+public:
+    void push(std::function<void()> call) {
+        std::scoped_lock lock{ mutex };
+        calls.push_back(std::move(call));
+
+        // Start another thread if all of them are busy
+        if (numIdle == 0 && threads.size() < maxThreads)
+            threads.emplace_back([this](std::stop_token stopToken) { loop(stopToken); });
+        else callAdded.notify_one();
+    }
+
+    // Waits for the running functions to return, then stops the threads.
+    void stop() {
+        threads.clear();
+    }
+};
+
 using WorkerThreadPool = std::forward_list<WorkerThread>;
 WorkerThreadPool threads;
 std::optional<Async::EventLoop> eventLoop;
+std::thread::id mainThreadID;
+BlockingPool blockingPool;
 
 Task<> queueFnToThread(WorkerThread& thread, std::function<Task<bool>()> f) {
     Async::CompletionResult result;
@@ -122,43 +196,134 @@ Task<> queueFnToThread(WorkerThread& thread, std::function<Task<bool>()> f) {
     // Copy the given function to preserve it when the coroutine is resumed
     auto tmp = f;
 
-    thread.push(result.coroHandle);
-    co_await std::suspend_always{};
+    // Re-queue in a loop instead of recursing, which would keep a frame alive for each time the function ran
+    do {
+        thread.push(result.coroHandle);
+        co_await std::suspend_always{};
+    } while (co_await tmp());
+}
+
+void Async::EventLoop::runOnce(bool wait) {
+    using namespace std::literals;
+
+    // Timers don't have their own timeouts, the wait ends when the next one fires
+    auto timeout = wait ? maxWaitTime : 0ms;
+    if (auto next = timers.nextTick()) {
+        auto untilNext = timerStart + std::chrono::milliseconds{ *next } - std::chrono::steady_clock::now();
+        timeout = std::clamp(std::chrono::ceil<std::chrono::milliseconds>(untilNext), 0ms, timeout);
+    }
+
+    runIO(timeout);
+    runTimers();
+
+    // Coroutines whose blocking functions returned on other threads
+    resumed.drain([this](std::coroutine_handle<> handle) {
+        numOperations--;
+        handle();
+    });
+}
+
+void Async::EventLoop::addTimer(Timer& timer, std::chrono::steady_clock::time_point deadline) {
+    // Round up so the timer doesn't fire before the deadline
+    timer.expiry = static_cast<std::uint64_t>(std::max(
+        std::chrono::ceil<std::chrono::milliseconds>(deadline - timerStart).count(), std::int64_t{ 0 }));
+    timers.add(timer);
+}
+
+void Async::EventLoop::runTimers() {
+    // Stops are requested from any thread, but the wheel is only changed here
+    stoppedTimers.drain([this](Timer* timer) {
+        if (timer->armed) timers.remove(*timer);
+        else numOperations--; // It fired after the stop claimed it, see below
+
+        timer->coroHandle();
+    });
+
+    if (timers.empty()) return;
 
-    if (co_await tmp()) co_await queueFnToThread(thread, tmp);
+    auto now = std::chrono::floor<std::chrono::milliseconds>(std::chrono::steady_clock::now() - timerStart);
+    timers.advance(static_cast<std::uint64_t>(now.count()), [this](TimerWheel::Timer& wheelTimer) {
+        auto& timer = static_cast<Timer&>(wheelTimer);
+
+        // A timer claimed by a stop is resumed once the stop is drained, keep counting it as waited on until then
+        if (timer.claimed.exchange(true)) numOperations++;
+        else timer.coroHandle();
+    });
+}
+
+Async::EventLoop& Async::currentEventLoop() {
+    return threadEventLoop ? *threadEventLoop : *eventLoop;
 }
 
-unsigned int Async::init(unsigned int numThreads, unsigned int queueEntries) {
+unsigned int Async::init(const Config& config) {
     // If 0 threads are specified, the number is chosen with hardware_concurrency.
     // If the number of supported threads cannot be determined, no worker threads are created.
     // The number of threads created is (desired number) - 1 since the main thread also runs an event loop.
-    unsigned int realNumThreads = numThreads == 0 ? std::max(std::thread::hardware_concurrency(), 1U) : numThreads;
-    eventLoop.emplace(realNumThreads, queueEntries);
+    unsigned int realNumThreads = config.numThreads == 0 ? std::max(std::thread::hardware_concurrency(), 1U)
+                                                         : config.numThreads;
+
+    // The backend can be chosen without changing the configuration (e.g., to run tests with epoll)
+    Config loopConfig = config;
+    if (const char* backend = std::getenv("WHALECONNECT_BACKEND")) {
+        std::string_view name = backend;
+        if (name == "epoll") loopConfig.backend = Backend::Epoll;
+        else if (name == "io_uring") loopConfig.backend = Backend::IOUring;
+    }
+
+    eventLoop.emplace(realNumThreads, loopConfig);
+    mainThreadID = std::this_thread::get_id();
+    threadEventLoop = &*eventLoop;
 
-    if (realNumThreads > 1)
-        for (unsigned int i = 0; i < realNumThreads - 1; i++) threads.emplace_front(queueEntries);
+    // Spread out the workers' polling threads over the CPUs following the one the main thread's polling thread is on
+    unsigned int numCPUs = std::max(std::thread::hardware_concurrency(), 1U);
+    Config workerConfig = loopConfig;
+
+    if (realNumThreads > 1) {
+        for (unsigned int i = 0; i < realNumThreads - 1; i++) {
+            if (config.sqPollCPU >= 0) workerConfig.sqPollCPU = static_cast<int>((config.sqPollCPU + i + 1) % numCPUs);
+            threads.emplace_front(workerConfig);
+        }
+    }
 
     return realNumThreads;
 }
 
 void Async::cleanup() {
+    // Blocking functions resume their coroutines through the event loops, so they are finished first
+    blockingPool.stop();
     threads.clear();
 }
 
 void Async::submit(const Operation& op) {
-    std::thread::id currentThread = std::this_thread::get_id();
-
-    // Push I/O to the worker thread that corresponds to the thread this function is running on
+    // Push I/O to the event loop that corresponds to the thread this function is running on
     // A coroutine will never leave a thread and will resume on the thread it suspended on.
+    submit(std::this_thread::get_id(), op);
+}
+
+void Async::submit(std::thread::id thread, const Operation& op) {
+    // Remember the socket so the operation can be canceled by itself
+    auto setHandle = [](const Operation& i) {
+        std::visit([](const OperationBase& j) {
+            if (j.result) j.result->handle = j.handle;
+        }, i);
+    };
+
+#if OS_LINUX
+    forEachOperation(op, setHandle);
+#else
+    setHandle(op);
+#endif
+
     for (auto i = threads.begin(); i != threads.end(); i++) {
-        if (i->getID() == currentThread) {
+        if (i->getID() == thread) {
             i->pushIO(op);
             return;
         }
     }
 
-    // If there is no corresponding worker thread, the operation was submitted in the main event loop
+    // If there is no corresponding worker thread, the operation is submitted in the main event loop
     eventLoop->push(op);
+    if (std::this_thread::get_id() != mainThreadID) eventLoop->interrupt();
 }
 
 Task<> Async::queueToThread() {
@@ -196,6 +361,60 @@ void Async::queueToThreadEx(std::thread::id id, std::function<Task<bool>()> f) {
         if (allThreads || i->getID() == id) queueFnToThread(*i, f);
 }
 
+Task<> Async::runBlocking(std::function<void()> fn) {
+    CompletionResult result;
+    co_await result;
+
+    EventLoop& loop = currentEventLoop();
+    loop.expectResume();
+
+    std::exception_ptr exception;
+    blockingPool.push([&] {
+        try {
+            fn();
+        } catch (...) {
+            exception = std::current_exception();
+        }
+
+        loop.resume(result.coroHandle);
+    });
+
+    co_await std::suspend_always{};
+    if (exception) std::rethrow_exception(exception);
+}
+
+Task<> Async::sleepUntil(std::chrono::steady_clock::time_point deadline, std::stop_token stopToken) {
+    CompletionResult result;
+    co_await result;
+
+    EventLoop& loop = currentEventLoop();
+    Timer timer;
+    timer.coroHandle = result.coroHandle;
+    loop.addTimer(timer, deadline);
+
+    // The stop can come from another thread (e.g., the first task to finish in whenAny), so it is handed to the event
+    // loop instead of changing the timer here
+    auto stop = [&loop, &timer] { loop.stopTimer(timer); };
+
+    std::optional<std::stop_callback<decltype(stop)>> onStop;
+    if (stopToken.stop_possible()) onStop.emplace(stopToken, stop);
+
+    co_await std::suspend_always{};
+}
+
+Task<> Async::sleep(std::chrono::milliseconds duration, std::stop_token stopToken) {
+    co_await sleepUntil(std::chrono::steady_clock::now() + duration, stopToken);
+}
+
+Task<> Async::PeriodicTimer::tick() {
+    co_await sleepUntil(next);
+
+    // Skip to the first tick after the current time
+    auto now = std::chrono::steady_clock::now();
+    next += interval;
+    if (next <= now) next += (now - next) / interval * interval + interval;
+}
+
 void Async::handleEvents(bool wait) {
     eventLoop->runOnce(wait);
 }
@@ -0,0 +1,363 @@
+// Copyright 2021-2024 Aidan Sun and the WhaleConnect contributors
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "async.epoll.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <string_view>
+#include <variant>
+
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "errcheck.hpp"
+#include "utils/overload.hpp"
+
+// Maximum number of events handled per wait
+constexpr int epollBatchSize = 64;
+
+Async::CompletionResult* getResult(const Async::Operation& op) {
+    return std::visit([](const Async::OperationBase& i) { return i.result; }, op);
+}
+
+// Checks if an operation waits for its socket to be writable instead of readable.
+bool isWrite(const Async::Operation& op) {
+    return std::holds_alternative<Async::Connect>(op) || std::holds_alternative<Async::Send>(op)
+        || std::holds_alternative<Async::SendTo>(op) || std::holds_alternative<Async::SendMessage>(op)
+        || std::holds_alternative<Async::SendZeroCopy>(op)
+        || std::holds_alternative<Async::Splice>(op) || std::holds_alternative<Async::Tee>(op);
+}
+
+// Checks if a descriptor refers to a socket.
+bool isSocket(int fd) {
+    struct stat info;
+    return fstat(fd, &info) == 0 && S_ISSOCK(info.st_mode);
+}
+
+// Sends as much of the remaining data as possible. The result is the total size once all data is sent.
+ssize_t sendRemaining(int s, std::string_view data, std::size_t& sent, const sockaddr* addr, socklen_t addrLen) {
+    while (sent < data.size()) {
+        ssize_t ret = sendto(s, data.data() + sent, data.size() - sent, MSG_NOSIGNAL | MSG_DONTWAIT, addr, addrLen);
+        if (ret < 0) return ret;
+
+        sent += static_cast<std::size_t>(ret);
+    }
+
+    return static_cast<ssize_t>(sent);
+}
+
+Async::EpollBackend::EpollBackend(int wakeFd) : epollFd(check(epoll_create1(EPOLL_CLOEXEC))), wakeFd(wakeFd) {
+    epoll_event event{ .events = EPOLLIN | EPOLLET, .data = { .fd = wakeFd } };
+    check(epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &event));
+}
+
+Async::EpollBackend::~EpollBackend() {
+    close(epollFd);
+}
+
+bool Async::EpollBackend::perform(PendingOperation& pending) {
+    ssize_t ret = 0;
+
+    Overload visitor{
+        [&](const Connect& op) {
+            // Connecting again gives the result of the connection that was started
+            ret = connect(op.handle, op.addr, op.addrLen);
+            if (ret < 0 && errno == EISCONN && pending.started) ret = 0;
+            if (ret < 0 && (errno == EINPROGRESS || errno == EALREADY)) errno = EAGAIN;
+
+            pending.started = true;
+        },
+        [&](const Accept& op) { ret = accept4(op.handle, op.addr, op.addrLen, SOCK_NONBLOCK | SOCK_CLOEXEC); },
+        [&](const Send& op) { ret = sendRemaining(op.handle, op.data, pending.sent, nullptr, 0); },
+        [&](const SendTo& op) { ret = sendRemaining(op.handle, op.data, pending.sent, op.addr, op.addrLen); },
+        [&](const Receive& op) { ret = recv(op.handle, op.data.data(), op.data.size(), MSG_DONTWAIT); },
+        [&](const ReceiveFrom& op) { ret = recvmsg(op.handle, op.msg, MSG_DONTWAIT); },
+        [](const Shutdown&) {},
+        [](const Close&) {},
+        [](const Cancel&) {},
+
+        // Each accept completes the operation, which is rearmed by its caller
+        [&](const AcceptMultishot& op) { ret = accept4(op.handle, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC); },
+
+        // There is no provided buffer ring, callers fall back to their own buffers
+        [&](const ReceiveProvided&) {
+            ret = -1;
+            errno = ENOBUFS;
+        },
+        [&](const ReceiveMultishot&) {
+            ret = -1;
+            errno = ENOBUFS;
+        },
+        [&](const ReceiveFromMultishot&) {
+            ret = -1;
+            errno = ENOBUFS;
+        },
+        [&](const SendMessage& op) { ret = sendmsg(op.handle, op.msg, MSG_DONTWAIT | MSG_NOSIGNAL); },
+        [&](const SendZeroCopy& op) { ret = sendRemaining(op.handle, op.data, pending.sent, nullptr, 0); },
+        [&](const Splice& op) {
+            // The offset is passed by value, callers advance it by the result
+            loff_t offset = op.sourceOffset;
+            loff_t* offsetPtr = op.sourceOffset < 0 ? nullptr : &offset;
+            ret = splice(op.source, offsetPtr, op.handle, nullptr, op.size, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        },
+        [&](const Tee& op) { ret = tee(op.source, op.handle, op.size, SPLICE_F_NONBLOCK); },
+        [&](const Write& op) { ret = write(op.handle, op.data.data(), op.data.size()); },
+        [](const Linked&) {},
+    };
+
+    std::visit(visitor, pending.op);
+    if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return false;
+
+    if (CompletionResult* result = getResult(pending.op)) {
+        if (ret < 0) result->error = errno;
+        else result->res = static_cast<int>(ret);
+    }
+
+    return true;
+}
+
+void Async::EpollBackend::queue(const Operation& op, int fd, CompletionResult* result, bool write) {
+    auto deadline = std::chrono::steady_clock::time_point::max();
+    if (result && result->hasTimeout()) {
+        deadline = std::chrono::steady_clock::now() + std::chrono::seconds{ result->timeout.tv_sec }
+            + std::chrono::nanoseconds{ result->timeout.tv_nsec };
+    }
+
+    PendingOperation pending{ op, deadline };
+
+    // Sockets are watched from their first operation until they are closed. They are made nonblocking, and events are
+    // edge-triggered: operations are performed until one would block, after which the next event is guaranteed.
+    auto [it, inserted] = files.try_emplace(fd);
+    if (inserted) {
+        epoll_event event{ .events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET, .data = { .fd = fd } };
+
+        int flags = fcntl(fd, F_GETFL);
+        bool added = flags >= 0 && (flags & O_NONBLOCK || fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0)
+            && epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) == 0;
+
+        if (!added) {
+            if (result) result->error = errno;
+
+            files.erase(it);
+            finish(result);
+            return;
+        }
+    }
+
+    // Try the operation right away unless earlier ones are waiting, the socket may already be ready
+    auto& list = write ? it->second.writes : it->second.reads;
+    if (list.empty() && perform(pending)) {
+        finish(result);
+        return;
+    }
+
+    if (result && result->hasTimeout()) numTimed++;
+    list.push_back(std::move(pending));
+}
+
+void Async::EpollBackend::process(std::list<PendingOperation>& pending) {
+    while (!pending.empty() && perform(pending.front())) {
+        if (pending.front().deadline != std::chrono::steady_clock::time_point::max()) numTimed--;
+
+        finish(getResult(pending.front().op));
+        pending.pop_front();
+    }
+}
+
+bool Async::EpollBackend::cancelWaiting(File& file, CompletionResult* target) {
+    std::size_t numCanceled = 0;
+    for (auto* list : { &file.reads, &file.writes }) {
+        numCanceled += std::erase_if(*list, [this, target](const PendingOperation& pending) {
+            CompletionResult* result = getResult(pending.op);
+            if (target && result != target) return false;
+
+            if (pending.deadline != std::chrono::steady_clock::time_point::max()) numTimed--;
+
+            if (result) result->error = ECANCELED;
+            finish(result);
+            return true;
+        });
+    }
+
+    return numCanceled > 0;
+}
+
+void Async::EpollBackend::cancel(int fd, CompletionResult* target) {
+    if (auto it = files.find(fd); it != files.end() && cancelWaiting(it->second, target)) return;
+
+    // An operation can wait on another descriptor than its handle (e.g., a splice from a socket waits for the socket
+    // to be readable, but its handle is the pipe it writes to)
+    if (!target) return;
+
+    for (auto& [_, file] : files)
+        if (cancelWaiting(file, target)) return;
+}
+
+std::chrono::milliseconds Async::EpollBackend::expire() {
+    auto now = std::chrono::steady_clock::now();
+    auto next = std::chrono::steady_clock::time_point::max();
+
+    // Time limits are rare, so the waiting operations are searched instead of being kept sorted by their deadlines
+    for (auto& [_, file] : files) {
+        for (auto* list : { &file.reads, &file.writes }) {
+            std::erase_if(*list, [this, now, &next](const PendingOperation& pending) {
+                if (pending.deadline > now) {
+                    next = std::min(next, pending.deadline);
+                    return false;
+                }
+
+                numTimed--;
+
+                CompletionResult* result = getResult(pending.op);
+                if (result) result->error = ETIMEDOUT;
+                finish(result);
+                return true;
+            });
+        }
+    }
+
+    if (next == std::chrono::steady_clock::time_point::max()) return std::chrono::milliseconds::max();
+
+    // Round up so the wait doesn't end just before the deadline
+    return std::chrono::ceil<std::chrono::milliseconds>(next - now);
+}
+
+void Async::EpollBackend::finish(CompletionResult* result) {
+    if (!result) return;
+
+    completed.push_back(result);
+
+    // Waiting chains are continued after the current wait. If the operation finished right away, advance() goes on
+    // with its chain instead.
+    if (auto it = chainResults.find(result); it != chainResults.end()) {
+        if (it->second->waiting) readyChains.push_back(it->second);
+
+        it->second->waiting = false;
+        chainResults.erase(it);
+    }
+}
+
+void Async::EpollBackend::advance(const std::shared_ptr<Chain>& chain) {
+    const auto& ops = *chain->operations;
+
+    while (chain->next < ops.size()) {
+        // With a soft link, the rest of the chain is canceled once an operation fails
+        CompletionResult* previous = chain->next > 0 ? getResult(ops[chain->next - 1]) : nullptr;
+        if (!chain->hard && previous && previous->error != 0) {
+            for (std::size_t i = chain->next; i < ops.size(); i++) {
+                CompletionResult* result = getResult(ops[i]);
+                if (result) result->error = ECANCELED;
+                finish(result);
+            }
+
+            return;
+        }
+
+        const Operation& op = ops[chain->next++];
+        CompletionResult* result = getResult(op);
+        if (result) chainResults.emplace(result, chain);
+
+        submit(op);
+
+        // The chain continues once the operation finishes if it has to wait
+        if (result && chainResults.contains(result)) {
+            chain->waiting = true;
+            return;
+        }
+    }
+}
+
+void Async::EpollBackend::submit(const Operation& op) {
+    Overload visitor{
+        [](const Shutdown& op) { shutdown(op.handle, SHUT_RDWR); },
+        [this](const Close& op) {
+            // Closing the socket also removes it from epoll
+            cancel(op.handle);
+            files.erase(op.handle);
+            close(op.handle);
+        },
+        [this](const Cancel& op) { cancel(op.handle, op.target); },
+        [this, &op](const Splice& i) {
+            // Splices from sockets wait for data to arrive. Other sources (pipes with data and files) are always
+            // ready, so the destination is waited on to have room.
+            if (isSocket(i.source)) queue(op, i.source, i.result, false);
+            else queue(op, i.handle, i.result, true);
+        },
+        [this, &op](const Write& i) {
+            // Regular files can't be watched with epoll (they are always ready), so they are written to right away
+            PendingOperation pending{ op, std::chrono::steady_clock::time_point::max() };
+            perform(pending);
+            finish(i.result);
+        },
+        [this](const Linked& op) { advance(std::make_shared<Chain>(op.operations, op.hard)); },
+        [this, &op](const auto& i) { queue(op, i.handle, i.result, isWrite(op)); },
+    };
+
+    std::visit(visitor, op);
+}
+
+void Async::EpollBackend::wait(std::chrono::milliseconds timeout) {
+    // Operations that finished when they were submitted are handled without waiting
+    if (!completed.empty()) timeout = {};
+    if (numTimed > 0) timeout = std::min(timeout, expire());
+
+    std::array<epoll_event, epollBatchSize> events;
+    int numEvents = epoll_wait(epollFd, events.data(), epollBatchSize, static_cast<int>(timeout.count()));
+
+    for (int i = 0; i < numEvents; i++) {
+        int fd = events[i].data.fd;
+
+        // Wakeups have no associated operation, reading the eventfd resets it
+        if (fd == wakeFd) {
+            std::uint64_t value;
+            (void)read(wakeFd, &value, sizeof(value));
+            continue;
+        }
+
+        auto it = files.find(fd);
+        if (it == files.end()) continue;
+
+        // Errors and hangups are reported by the operations' system calls
+        std::uint32_t flags = events[i].events;
+        bool failed = flags & (EPOLLERR | EPOLLHUP);
+
+        if (failed || flags & (EPOLLIN | EPOLLRDHUP)) process(it->second.reads);
+        if (failed || flags & EPOLLOUT) process(it->second.writes);
+    }
+
+    if (numTimed > 0) expire();
+
+    // Continue chains whose operations finished
+    while (!readyChains.empty()) {
+        auto chain = std::move(readyChains.front());
+        readyChains.pop_front();
+        advance(chain);
+    }
+}
+
+void Async::EventLoop::runIOEpoll(std::chrono::milliseconds timeout) {
+    if (operations.empty() && numOperations == 0 && timers.empty()) return;
+
+    operations.drain([this](const Operation& op) {
+        // Only operations with a completion result are waited on
+        numOperations += numResults(op);
+
+        epoll->submit(op);
+    });
+
+    epoll->wait(timeout);
+
+    for (CompletionResult* result : epoll->takeCompleted()) {
+        numOperations--;
+        result->coroHandle();
+    }
+}
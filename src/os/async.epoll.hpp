@@ -0,0 +1,102 @@
+// Copyright 2021-2024 Aidan Sun and the WhaleConnect contributors
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <deque>
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "async.hpp"
+
+namespace Async {
+    // Event loop backend based on epoll, used on Linux instead of io_uring if it is selected or unavailable.
+    //
+    // Operations are performed with nonblocking system calls, right away if possible and otherwise once their sockets
+    // are ready. Their completion results are filled in like they would be with io_uring, so sockets work the same way
+    // with both backends.
+    class EpollBackend {
+        // An operation waiting for its socket to be ready.
+        struct PendingOperation {
+            Operation op;
+            std::chrono::steady_clock::time_point deadline; // When the operation times out (max if it has no limit)
+            std::size_t sent = 0; // Bytes sent so far (sends finish once all their data is sent)
+            bool started = false; // If a connection has been started
+        };
+
+        // Operations waiting on a socket, in the order they were submitted.
+        struct File {
+            std::list<PendingOperation> reads;
+            std::list<PendingOperation> writes;
+        };
+
+        // A chain of linked operations that is being run.
+        struct Chain {
+            std::shared_ptr<const std::vector<Operation>> operations;
+            bool hard;
+            std::size_t next = 0; // Index of the next operation to start
+            bool waiting = false; // If an operation of the chain is waiting for its socket
+        };
+
+        int epollFd;
+        int wakeFd;
+        std::unordered_map<int, File> files;
+        std::size_t numTimed = 0; // Number of waiting operations with a time limit
+        std::vector<CompletionResult*> completed;
+        std::unordered_map<CompletionResult*, std::shared_ptr<Chain>> chainResults; // Chains by running operations
+        std::deque<std::shared_ptr<Chain>> readyChains; // Chains whose operations finished while waiting
+
+        // Makes an operation's system call. Returns false if the socket is not ready for it.
+        static bool perform(PendingOperation& pending);
+
+        // Starts watching a socket, then queues an operation on it or finishes it right away.
+        void queue(const Operation& op, int fd, CompletionResult* result, bool write);
+
+        // Performs waiting operations in order until one of them would block.
+        void process(std::list<PendingOperation>& pending);
+
+        // Finishes operations in a socket's lists with ECANCELED, either all of them or a specific one. Returns if any
+        // were found.
+        bool cancelWaiting(File& file, CompletionResult* target);
+
+        // Cancels operations waiting on a socket, either all of them or a specific one. A specific operation that isn't
+        // waiting on the socket is searched for on the others.
+        void cancel(int fd, CompletionResult* target = nullptr);
+
+        // Finishes operations whose time limits have passed with ETIMEDOUT. Returns the time until the next limit.
+        std::chrono::milliseconds expire();
+
+        // Adds the completion result of a finished operation to be returned, if it has one. If it is part of a chain,
+        // the chain is continued.
+        void finish(CompletionResult* result);
+
+        // Starts the operations of a chain in order until one of them has to wait.
+        void advance(const std::shared_ptr<Chain>& chain);
+
+    public:
+        explicit EpollBackend(int wakeFd);
+
+        ~EpollBackend();
+
+        EpollBackend(const EpollBackend&) = delete;
+
+        EpollBackend& operator=(const EpollBackend&) = delete;
+
+        // Starts an operation. It may finish before this function returns.
+        void submit(const Operation& op);
+
+        // Waits up to the given time for sockets to be ready (unless operations have already finished), then performs
+        // their operations.
+        void wait(std::chrono::milliseconds timeout);
+
+        // Takes the completion results of the operations that finished.
+        std::vector<CompletionResult*> takeCompleted() {
+            return std::exchange(completed, {});
+        }
+    };
+}
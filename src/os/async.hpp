@@ -3,11 +3,20 @@
 
 #pragma once
 
+#include <array>
+#include <atomic>
+#include <chrono>
 #include <coroutine>
+#include <cstddef>
+#include <cstdint>
 #include <functional>
+#include <memory>
+#include <optional>
+#include <stop_token>
+#include <string>
+#include <string_view>
 #include <thread>
 #include <variant>
-#include <vector>
 
 #if OS_WINDOWS
 #include <WinSock2.h>
@@ -18,7 +27,12 @@
 #include <sys/event.h>
 #include <unistd.h>
 #elif OS_LINUX
+#include <deque>
+#include <unordered_map>
+#include <vector>
+
 #include <liburing.h>
+#include <linux/time_types.h>
 #include <sys/socket.h>
 #include <unistd.h>
 #endif
@@ -26,9 +40,54 @@
 #include "error.hpp"
 #include "net/enums.hpp"
 #include "sockets/delegates/traits.hpp"
+#include "utils/mpscqueue.hpp"
 #include "utils/task.hpp"
+#include "utils/timerwheel.hpp"
 
 namespace Async {
+    // I/O backends on Linux.
+    enum class Backend { IOUring, Epoll };
+
+    // Combinations of io_uring setup options, tried in order of preference. Features the kernel doesn't support are
+    // dropped.
+    enum class SetupProfile {
+        // No additional options.
+        Default,
+
+        // Completions are processed in batches when a thread waits for them (IORING_SETUP_DEFER_TASKRUN), and event
+        // loops attach to the first one's kernel workers (IORING_SETUP_ATTACH_WQ). Loops don't attach with submission
+        // queue polling, so each one keeps its own polling thread.
+        Throughput,
+
+        // Completions are processed as soon as a thread enters the kernel, without interrupting it while it runs
+        // (IORING_SETUP_COOP_TASKRUN).
+        Latency
+    };
+
+    // Options for the OS async APIs.
+    struct Config {
+        unsigned int numThreads = 0; // Number of threads including the main thread (0 to use hardware concurrency)
+        unsigned int queueEntries = 1024; // Number of io_uring submission queue entries (Linux only)
+        unsigned int completionEntries = 4096; // Number of io_uring completion queue entries (Linux only, 0 for 2x)
+        std::size_t zeroCopyThreshold = 0; // Minimum size of sends that are made without copying (0 to disable)
+
+        // Submission queue polling (Linux only)
+        // A kernel thread per event loop picks up submissions, then sleeps after being idle for the given time. It can
+        // be pinned to a CPU, in which case worker threads' polling threads are pinned to the following CPUs.
+        bool sqPoll = false;
+        unsigned int sqPollIdle = 1000; // In milliseconds
+        int sqPollCPU = -1; // -1 to not pin
+
+        // io_uring setup profile (Linux only)
+        // Profiles other than the default also register the ring descriptors to make system calls cheaper.
+        SetupProfile setupProfile = SetupProfile::Default;
+
+        // I/O backend (Linux only)
+        // io_uring falls back to epoll if it can't be set up (e.g., if it is disabled by the system's policy). The
+        // WHALECONNECT_BACKEND environment variable ("io_uring" or "epoll") overrides this.
+        Backend backend = Backend::IOUring;
+    };
+
     // The information needed to resume a completion operation.
     //
     // This structure contains functions to make it an awaitable type. Calling co_await on an instance stores the
@@ -43,6 +102,14 @@ namespace Async {
         std::coroutine_handle<> coroHandle; // The handle to the coroutine that started the operation
         System::ErrorCode error = 0; // The return code of the asynchronous function (returned to caller)
         int res = 0; // The result the operation (returned to caller, exact meaning depends on operation)
+        Traits::SocketHandleType<SocketTag::IP> handle{}; // The socket the operation was submitted on
+
+#if OS_LINUX
+        std::uint32_t flags = 0; // The CQE flags of the operation (e.g., which provided buffer was selected)
+        __kernel_timespec timeout{}; // The time limit of the operation (zero for none)
+        unsigned int pendingCompletions = 1; // Completions left before the operation is finished (including a timeout)
+        bool timedOut = false; // If the time limit expired
+#endif
 
 #if OS_WINDOWS
         std::thread::id thread = std::this_thread::get_id();
@@ -52,6 +119,18 @@ namespace Async {
         CompletionResult() = default;
 #endif
 
+#if OS_LINUX
+        // Checks if the operation will produce more completions (multishot operations only).
+        bool hasMore() const {
+            return flags & IORING_CQE_F_MORE;
+        }
+
+        // Checks if the operation has a time limit.
+        bool hasTimeout() const {
+            return timeout.tv_sec > 0 || timeout.tv_nsec > 0;
+        }
+#endif
+
         // Throws an exception if a fatal error occurred asynchronously.
         void checkError(System::ErrorType type) const {
             if (System::isFatal(error)) throw System::SystemError{ error, type };
@@ -128,14 +207,113 @@ namespace Async {
 
     struct Close : OperationBase {};
 
-    struct Cancel : OperationBase {};
+    // Cancels pending operations on a socket.
+    struct Cancel : OperationBase {
+        CompletionResult* target = nullptr; // The operation to cancel (null to cancel all of them)
+    };
+
+#if OS_LINUX
+    // Accept operation that keeps accepting clients, producing one completion for each, until it is canceled or fails.
+    struct AcceptMultishot : OperationBase {};
+
+    // Receive operation that reads into a buffer selected by the kernel from the event loop's provided buffer ring.
+    struct ReceiveProvided : OperationBase {
+        std::size_t size;
+    };
+
+    // Receive operation that keeps receiving into provided buffers, producing one completion for each buffer filled,
+    // until the connection is closed, the operation is canceled, or it fails.
+    struct ReceiveMultishot : OperationBase {};
+
+    // Receive operation that keeps receiving datagrams into provided buffers, producing one completion for each. Each
+    // buffer starts with an io_uring_recvmsg_out header followed by the source address and the payload, laid out
+    // according to the message header, which must stay valid until the operation ends.
+    struct ReceiveFromMultishot : OperationBase {
+        msghdr* msg;
+    };
+
+    // Send operation that transmits a message with control data (e.g., the segment size for UDP segmentation offload).
+    // The message header and everything it refers to must stay valid until the operation completes.
+    struct SendMessage : OperationBase {
+        const msghdr* msg;
+    };
+
+    // Send operation that transmits directly from the caller's buffer. The buffer must stay valid until the kernel
+    // posts a notification completion after the send completion.
+    struct SendZeroCopy : OperationBase {
+        std::string_view data;
+    };
+
+    // Operation that moves data from a descriptor into the socket (or any other descriptor) without copying it through
+    // user space. One of the two descriptors must be a pipe.
+    struct Splice : OperationBase {
+        int source;
+        std::int64_t sourceOffset; // Offset to read the source from (-1 for pipes)
+        unsigned int size;
+    };
+
+    // Operation that copies data from one pipe (source) into another (handle) without taking it out of the source.
+    struct Tee : OperationBase {
+        int source;
+        unsigned int size;
+    };
+
+    // Operation that writes data to a file (handle) at its current position.
+    struct Write : OperationBase {
+        std::string_view data;
+    };
+
+    struct Linked;
+
+    using Operation = std::variant<Connect, Accept, Send, SendTo, Receive, ReceiveFrom, Shutdown, Close, Cancel,
+        AcceptMultishot, ReceiveProvided, ReceiveMultishot, ReceiveFromMultishot, SendMessage, SendZeroCopy, Splice, Tee,
+        Write, Linked>;
 
+    // Chain of operations that are started one after another, each once the previous one has finished. With a soft
+    // link, an operation that fails ends the chain and the ones after it fail with ECANCELED. With a hard link, the
+    // rest of the chain runs regardless. The chain's own completion result must be null (its operations each have
+    // their own), and it can't contain other chains.
+    struct Linked : OperationBase {
+        std::shared_ptr<const std::vector<Operation>> operations;
+        bool hard = false;
+    };
+
+    // Calls a function with an operation, or with each operation of a chain.
+    void forEachOperation(const Operation& op, auto fn) {
+        if (auto linked = std::get_if<Linked>(&op)) {
+            for (const auto& i : *linked->operations) fn(i);
+        } else {
+            fn(op);
+        }
+    }
+
+    // Gets the number of completion results an operation (or each operation of a chain) finishes.
+    inline std::size_t numResults(const Operation& op) {
+        std::size_t count = 0;
+        forEachOperation(op, [&count](const Operation& i) {
+            if (std::visit([](const OperationBase& j) { return j.result != nullptr; }, i)) count++;
+        });
+
+        return count;
+    }
+#else
     using Operation = std::variant<Connect, Accept, Send, SendTo, Receive, ReceiveFrom, Shutdown, Close, Cancel>;
+#endif
+
+    // A timer awaited by a coroutine, which is resumed when it fires or when it is stopped, whichever claims it first.
+    struct Timer : TimerWheel::Timer {
+        std::coroutine_handle<> coroHandle;
+        std::atomic_bool claimed = false;
+    };
 
 #if OS_MACOS
     using PendingEventsMap = std::unordered_map<std::uint64_t, Async::CompletionResult*>;
 #endif
 
+#if OS_LINUX
+    class EpollBackend;
+#endif
+
     class EventLoop {
 #if OS_WINDOWS
         std::thread::id thisId;
@@ -144,52 +322,267 @@ namespace Async {
         PendingEventsMap pendingEvents;
 #elif OS_LINUX
         io_uring ring;
+        unsigned int fireAndForgetFlags = 0; // SQE flags for operations without a completion result
+        int wakeFd = -1; // eventfd used to interrupt waits from other threads
+        std::uint64_t wakeValue = 0; // Buffer for reading the eventfd
+        io_uring_buf_ring* bufRing = nullptr; // Provided buffer ring (null if unsupported by the kernel)
+        std::unique_ptr<char[]> bufMemory; // Memory backing the provided buffers
+        bool hasFixedFiles = false; // If the fixed file table was registered
+        std::unordered_map<int, unsigned int> fixedFiles; // File descriptors and their fixed file table slots
+        std::vector<unsigned int> freeFixedSlots;
+        std::size_t zeroCopyThreshold = 0; // Minimum size of zero-copy sends (0 if disabled or unsupported)
+        bool wakeReadArmed = false; // If a read on the eventfd is pending
+        std::deque<Operation> deferredOperations; // Operations that did not fit in the submission queue
+        std::unique_ptr<EpollBackend> epoll; // Backend used instead of io_uring if set
+
+        // Submits queued operations and handles completed ones with the epoll backend.
+        void runIOEpoll(std::chrono::milliseconds timeout);
+
+        // Gets the number of SQEs needed to submit an operation.
+        unsigned int getNumSqes(const Operation& op) const;
+
+        // Queues the removal of a file descriptor from the fixed file table if it is registered.
+        void unregisterFile(int fd);
 #endif
 
-        std::vector<Operation> operations;
+        MPSCQueue<Operation, 1024> operations; // Operations waiting to be submitted, can be pushed from any thread
         std::size_t numOperations = 0; // Events that are being waited on (not events in the queue)
 
+        MPSCQueue<std::coroutine_handle<>, 64> resumed; // Coroutines to resume, can be pushed from any thread
+        MPSCQueue<Timer*, 64> stoppedTimers; // Timers to disarm and resume early, can be pushed from any thread
+
+        // Timers, in ticks of one millisecond since the event loop was created
+        TimerWheel timers;
+        std::chrono::steady_clock::time_point timerStart = std::chrono::steady_clock::now();
+
+        // Submits queued operations and handles completed ones, waiting up to the given time if none have completed.
+        void runIO(std::chrono::milliseconds timeout);
+
+        // Resumes the coroutines of timers that have been stopped or have fired.
+        void runTimers();
+
     public:
-        EventLoop(unsigned int numThreads, unsigned int queueEntries);
+        EventLoop(unsigned int numThreads, const Config& config);
 
         ~EventLoop();
 
         // Runs one iteration of this event loop.
         void runOnce(bool wait = true);
 
-        // Returns the number of I/O events that are being waited on.
+        // Wakes up this event loop if it is waiting in runOnce. This function can be called from any thread.
+        void interrupt();
+
+        // Returns the number of I/O events and timers that are being waited on.
         std::size_t size() {
-            return numOperations;
+            return numOperations + timers.size();
+        }
+
+        // Checks if operations are waiting to be submitted, including ones without completion results (e.g., closes)
+        // that size() doesn't count. Must be called from the thread running this event loop.
+        bool hasQueuedOperations() {
+#if OS_LINUX
+            if (!deferredOperations.empty()) return true;
+#endif
+            return !operations.empty();
         }
 
+        // Counts a coroutine that will be queued with resume() as waited on. Must be called from the thread running
+        // this event loop.
+        void expectResume() {
+            numOperations++;
+        }
+
+        // Queues a coroutine to be resumed on the next iteration. This function can be called from any thread.
+        void resume(std::coroutine_handle<> handle) {
+            resumed.push(handle);
+            interrupt();
+        }
+
+        // Arms a timer to resume its coroutine at a deadline. Must be called from the thread running this event loop.
+        void addTimer(Timer& timer, std::chrono::steady_clock::time_point deadline);
+
+        // Disarms a timer if it is armed. Must be called from the thread running this event loop.
+        void removeTimer(Timer& timer) {
+            timers.remove(timer);
+        }
+
+        // Disarms a timer and resumes its coroutine on the next iteration, unless it has already fired. This function
+        // can be called from any thread.
+        void stopTimer(Timer& timer) {
+            if (timer.claimed.exchange(true)) return;
+
+            stoppedTimers.push(&timer);
+            interrupt();
+        }
+
+        // Queues an operation to be submitted on the next iteration. This function can be called from any thread.
         void push(const Operation& operation) {
-            operations.push_back(operation);
+            operations.push(operation);
+        }
+
+#if OS_LINUX
+        // Gets the backend this event loop uses.
+        Backend getBackend() const {
+            return epoll ? Backend::Epoll : Backend::IOUring;
         }
+
+        // Gets the size of each buffer in the provided buffer ring, or 0 if the ring is unavailable.
+        std::size_t getProvidedBufferSize() const;
+
+        // Copies the data out of the provided buffer selected by a completed operation, then returns the buffer to the
+        // ring so the kernel can use it again.
+        std::string consumeProvidedBuffer(const CompletionResult& result);
+
+        // Registers a file descriptor in the fixed file table so its operations skip the kernel's file lookups. It is
+        // unregistered when a Close operation for it is submitted through this event loop. Must be called from the
+        // thread running this event loop. Returns false if the descriptor could not be registered.
+        bool registerFile(int fd);
+
+        // Gets the minimum size of sends that should be made without copying, or 0 if zero-copy sends are disabled or
+        // unsupported by the kernel.
+        std::size_t getZeroCopyThreshold() const {
+            return zeroCopyThreshold;
+        }
+#endif
     };
 
+    // Submits an I/O operation to the async event loop.
+    void submit(const Operation& op);
+
+    // Submits an I/O operation to the event loop running on a specific thread (or the main event loop if the thread
+    // has no event loop). This function can be called from any thread. The coroutine awaiting the operation, if any,
+    // is resumed on the thread that the operation was submitted to.
+    void submit(std::thread::id thread, const Operation& op);
+
     // Awaits an asynchronous operation and returns the result.
-    Task<CompletionResult> run(auto fn, System::ErrorType type = System::ErrorType::System) {
+    // The operation fails with a timeout error if it does not finish within the time limit, if one is given (only
+    // supported on Linux). It is canceled by itself, leaving other operations on its socket running, if a stop is
+    // requested through the stop token.
+    Task<CompletionResult> run(auto fn, System::ErrorType type = System::ErrorType::System,
+        std::chrono::milliseconds timeout = {}, std::stop_token stopToken = {}) {
         CompletionResult result;
         co_await result;
 
+#if OS_LINUX
+        auto seconds = std::chrono::duration_cast<std::chrono::seconds>(timeout);
+        result.timeout = { seconds.count(), std::chrono::nanoseconds{ timeout - seconds }.count() };
+#else
+        (void)timeout;
+#endif
+
         fn(result);
 
+        // The cancellation is queued behind the operation on the same event loop. If the operation finishes first, the
+        // cancellation is still handled before anything submitted after this function returns, so it can't affect
+        // another operation reusing the completion result's address.
+        auto cancel = [&result, thread = std::this_thread::get_id()] {
+            submit(thread, Cancel{ { result.handle, nullptr }, &result });
+        };
+
+        std::optional<std::stop_callback<decltype(cancel)>> onStop;
+        if (stopToken.stop_possible()) onStop.emplace(stopToken, cancel);
+
         co_await std::suspend_always{};
+
+#if OS_LINUX
+        // Some operations post more completions (e.g., zero-copy send notifications), their buffers must not be
+        // released until the last one
+        while (result.hasMore()) co_await std::suspend_always{};
+#endif
+
         result.checkError(type);
 
         co_return result;
     }
 
+#if OS_LINUX
+    // Awaits a chain of linked operations (see Linked) and returns their results in order. The function is given the
+    // completion results to create the operations with, each of which must finish one of them. An exception is thrown
+    // for the first operation that failed. Each operation can have a time limit.
+    template <std::size_t N>
+    Task<std::array<CompletionResult, N>> runLinked(auto fn, System::ErrorType type = System::ErrorType::System,
+        std::chrono::milliseconds timeout = {}, bool hard = false) {
+        std::array<CompletionResult, N> results;
+        // Awaited through a reference, GCC may copy awaitables returned from function calls
+        CompletionResult& first = results.front();
+        co_await first;
+
+        auto seconds = std::chrono::duration_cast<std::chrono::seconds>(timeout);
+        for (auto& i : results) {
+            i.coroHandle = first.coroHandle;
+            i.timeout = { seconds.count(), std::chrono::nanoseconds{ timeout - seconds }.count() };
+        }
+
+        submit(Linked{ { -1, nullptr }, std::make_shared<const std::vector<Operation>>(fn(results)), hard });
+
+        // Every result resumes the coroutine once, the results are only released after the last one. The kernel
+        // starts each operation as soon as the previous one finishes, so their completions usually arrive together
+        // and are handled in the same event loop iteration.
+        for (std::size_t i = 0; i < N; i++) co_await std::suspend_always{};
+
+        for (const auto& i : results) i.checkError(type);
+
+        co_return results;
+    }
+
+    // Awaits a multishot asynchronous operation, calling a function with the result of each completion. Returns once
+    // the operation stops producing completions without an error.
+    Task<> runMultishot(auto fn, auto onResult, System::ErrorType type = System::ErrorType::System) {
+        CompletionResult result;
+        co_await result;
+
+        fn(result);
+
+        do {
+            co_await std::suspend_always{};
+            result.checkError(type);
+
+            onResult(result);
+        } while (result.hasMore());
+    }
+#endif
+
+    // Runs a blocking function (e.g., a DNS lookup) on a separate thread so the event loops aren't stalled by it. The
+    // current coroutine is resumed on its thread once the function returns. Exceptions thrown by the function are
+    // rethrown in the coroutine.
+    Task<> runBlocking(std::function<void()> fn);
+
+    // Suspends the current coroutine until a deadline. It is resumed by the event loop of the current thread, early if
+    // a stop is requested through the stop token (from any thread).
+    Task<> sleepUntil(std::chrono::steady_clock::time_point deadline, std::stop_token stopToken = {});
+
+    // Suspends the current coroutine for a duration. It is resumed by the event loop of the current thread, early if a
+    // stop is requested through the stop token (from any thread).
+    Task<> sleep(std::chrono::milliseconds duration, std::stop_token stopToken = {});
+
+    // Timer that fires at a fixed interval (which must be positive), awaited by one coroutine at a time.
+    // Each tick is scheduled from the previous one so the interval doesn't drift with the time it takes to handle them.
+    // Ticks that were missed while the coroutine was busy are skipped.
+    class PeriodicTimer {
+        std::chrono::milliseconds interval;
+        std::chrono::steady_clock::time_point next;
+
+    public:
+        explicit PeriodicTimer(std::chrono::milliseconds interval) :
+            interval(interval), next(std::chrono::steady_clock::now() + interval) {}
+
+        // Waits for the next tick.
+        Task<> tick();
+    };
+
+    // Gets the event loop running on the current thread (the main event loop if the thread has no event loop).
+    EventLoop& currentEventLoop();
+
     // Initializes the OS async APIs.
     // Returns the total number of threads created, including the main thread.
-    unsigned int init(unsigned int numThreads, unsigned int queueEntries);
+    // On Linux, splicing into a closed socket (when sending files or relaying) raises SIGPIPE since there is no flag
+    // like MSG_NOSIGNAL for it. Programs should ignore the signal so the operations fail with EPIPE instead, this
+    // function leaves signal handling to them.
+    unsigned int init(const Config& config);
 
     // Explicit cleanup is needed for guaranteed object destruction order.
     void cleanup();
 
-    // Submits an I/O operation to the async event loop.
-    void submit(const Operation& op);
-
     // Submits work to a worker thread.
     Task<> queueToThread();
 
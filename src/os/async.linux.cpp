@@ -2,18 +2,113 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
 
 #include "async.hpp"
+#include "async.epoll.hpp"
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
 #include <cstring>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <unordered_map>
 #include <variant>
 
+#include <fcntl.h>
 #include <liburing.h>
 #include <linux/time_types.h>
+#include <sys/eventfd.h>
 #include <sys/socket.h>
+#include <unistd.h>
 
 #include "errcheck.hpp"
 #include "utils/overload.hpp"
 
-void handleOperation(io_uring& ring, const Async::Operation& next) {
+// Maximum number of CQEs harvested from the completion queue at once
+constexpr unsigned int cqeBatchSize = 64;
+
+// Provided buffer ring configuration
+// The buffers are allocated without being initialized, so their pages only take up memory once the kernel writes
+// received data into them.
+// Each buffer also has room for the headers of a multishot recvmsg along with a whole coalesced UDP message (see
+// UDPOffload).
+constexpr unsigned int numProvidedBuffers = 64;
+constexpr unsigned int providedBufferSize = 65 * 1024;
+constexpr int bufferGroupID = 0;
+
+// Number of slots in the fixed file table
+constexpr unsigned int numFixedFiles = 4096;
+
+// Ring descriptor of the first event loop set up with the throughput profile, which later ones attach to
+std::atomic_int sharedWqFd = -1;
+
+// Placeholder descriptor to clear fixed file slots with (only read by the kernel)
+int noFile = -1;
+
+// Tags in the low bits of user data for completions without their own completion results
+// Completion results are aligned, so tagged user data can be distinguished from pointers to them.
+constexpr std::uintptr_t releasedSlotTag = 1;
+constexpr std::uintptr_t linkedTimeoutTag = 2;
+
+// User data for clearing a fixed file slot
+void* makeReleasedSlotTag(unsigned int slot) {
+    return reinterpret_cast<void*>((std::uintptr_t{ slot } << 2) | releasedSlotTag);
+}
+
+std::optional<unsigned int> getReleasedSlot(void* userData) {
+    auto value = reinterpret_cast<std::uintptr_t>(userData);
+    if ((value & 3) != releasedSlotTag) return std::nullopt;
+
+    return static_cast<unsigned int>(value >> 2);
+}
+
+// User data for a timeout linked to an operation
+void* makeLinkedTimeoutTag(Async::CompletionResult* result) {
+    return reinterpret_cast<void*>(reinterpret_cast<std::uintptr_t>(result) | linkedTimeoutTag);
+}
+
+Async::CompletionResult* getLinkedTimeoutResult(void* userData) {
+    auto value = reinterpret_cast<std::uintptr_t>(userData);
+    if ((value & 3) != linkedTimeoutTag) return nullptr;
+
+    return reinterpret_cast<Async::CompletionResult*>(value & ~linkedTimeoutTag);
+}
+
+// Information copied from a CQE.
+struct Completion {
+    void* userData;
+    int res;
+    std::uint32_t flags;
+};
+
+// Makes sure the submission queue has space for a number of SQEs, submitting the queued ones if it is full.
+// Returns false if there is still not enough space (e.g., a polling kernel thread has not caught up yet).
+bool reserveSqes(io_uring& ring, unsigned int count) {
+    if (io_uring_sq_space_left(&ring) >= count) return true;
+
+    io_uring_submit(&ring);
+    return io_uring_sq_space_left(&ring) >= count;
+}
+
+// Prepares SQEs for an operation. The submission queue must have space for them (see EventLoop::getNumSqes).
+// The link flags are set on the operation's last SQE to link it to the next one.
+void handleOperation(io_uring& ring, const Async::Operation& next, unsigned int fireAndForgetFlags,
+    const std::unordered_map<int, unsigned int>& fixedFiles, unsigned int linkFlags = 0) {
+    // Each operation of a chain is linked to the one after it
+    if (auto linked = std::get_if<Async::Linked>(&next)) {
+        unsigned int flags = linked->hard ? IOSQE_IO_HARDLINK : IOSQE_IO_LINK;
+        const auto& ops = *linked->operations;
+
+        for (std::size_t i = 0; i < ops.size(); i++)
+            handleOperation(ring, ops[i], fireAndForgetFlags, fixedFiles, i + 1 < ops.size() ? flags : 0);
+
+        return;
+    }
+
     io_uring_sqe* sqe = io_uring_get_sqe(&ring);
 
     Overload visitor{
@@ -44,62 +139,431 @@ void handleOperation(io_uring& ring, const Async::Operation& next) {
         [=](const Async::Shutdown& op) {
             io_uring_prep_shutdown(sqe, op.handle, SHUT_RDWR);
             io_uring_sqe_set_data(sqe, nullptr);
+            io_uring_sqe_set_flags(sqe, fireAndForgetFlags);
         },
         [=](const Async::Close& op) {
             io_uring_prep_close(sqe, op.handle);
             io_uring_sqe_set_data(sqe, nullptr);
+            io_uring_sqe_set_flags(sqe, fireAndForgetFlags);
         },
         [=](const Async::Cancel& op) {
-            io_uring_prep_cancel_fd(sqe, op.handle, IORING_ASYNC_CANCEL_ALL);
+            // A single operation is identified by its user data
+            if (op.target) io_uring_prep_cancel(sqe, op.target, 0);
+            else io_uring_prep_cancel_fd(sqe, op.handle, IORING_ASYNC_CANCEL_ALL);
             io_uring_sqe_set_data(sqe, nullptr);
+            io_uring_sqe_set_flags(sqe, fireAndForgetFlags);
+        },
+        [=](const Async::AcceptMultishot& op) {
+            // The peer address is not requested since all completions would write to the same location
+            io_uring_prep_multishot_accept(sqe, op.handle, nullptr, nullptr, 0);
+            io_uring_sqe_set_data(sqe, op.result);
+        },
+        [=](const Async::ReceiveProvided& op) {
+            io_uring_prep_recv(sqe, op.handle, nullptr, op.size, MSG_NOSIGNAL);
+            io_uring_sqe_set_data(sqe, op.result);
+            io_uring_sqe_set_flags(sqe, IOSQE_BUFFER_SELECT);
+            sqe->buf_group = bufferGroupID;
+        },
+        [=](const Async::SendMessage& op) {
+            io_uring_prep_sendmsg(sqe, op.handle, op.msg, MSG_NOSIGNAL);
+            io_uring_sqe_set_data(sqe, op.result);
+        },
+        [=](const Async::SendZeroCopy& op) {
+            io_uring_prep_send_zc(sqe, op.handle, op.data.data(), op.data.size(), MSG_NOSIGNAL, 0);
+            io_uring_sqe_set_data(sqe, op.result);
+        },
+        [=](const Async::Splice& op) {
+            io_uring_prep_splice(sqe, op.source, op.sourceOffset, op.handle, -1, op.size, SPLICE_F_MOVE);
+            io_uring_sqe_set_data(sqe, op.result);
+        },
+        [=](const Async::Tee& op) {
+            io_uring_prep_tee(sqe, op.source, op.handle, op.size, 0);
+            io_uring_sqe_set_data(sqe, op.result);
+        },
+        [=](const Async::Write& op) {
+            // An offset of -1 uses (and advances) the file position
+            io_uring_prep_write(sqe, op.handle, op.data.data(), static_cast<unsigned int>(op.data.size()), -1);
+            io_uring_sqe_set_data(sqe, op.result);
+        },
+        [=](const Async::ReceiveMultishot& op) {
+            // The length must be 0, each completion selects a whole buffer
+            io_uring_prep_recv_multishot(sqe, op.handle, nullptr, 0, MSG_NOSIGNAL);
+            io_uring_sqe_set_data(sqe, op.result);
+            io_uring_sqe_set_flags(sqe, IOSQE_BUFFER_SELECT);
+            sqe->buf_group = bufferGroupID;
+        },
+        [=](const Async::ReceiveFromMultishot& op) {
+            io_uring_prep_recvmsg_multishot(sqe, op.handle, op.msg, 0);
+            io_uring_sqe_set_data(sqe, op.result);
+            io_uring_sqe_set_flags(sqe, IOSQE_BUFFER_SELECT);
+            sqe->buf_group = bufferGroupID;
+        },
+        [](const Async::Linked&) {
+            // Chains are prepared above
         },
     };
 
     std::visit(visitor, next);
+
+    // Refer to registered sockets by their fixed file slots
+    // Close and cancel operations use the regular descriptor, the fixed file is unregistered separately.
+    bool usesFile = !std::holds_alternative<Async::Close>(next) && !std::holds_alternative<Async::Cancel>(next);
+
+    if (auto it = fixedFiles.find(sqe->fd); usesFile && it != fixedFiles.end()) {
+        sqe->fd = static_cast<int>(it->second);
+        sqe->flags |= IOSQE_FIXED_FILE;
+    }
+
+    // Link a timeout to the operation if it has a time limit
+    // The kernel cancels the operation when the timeout expires. Both post completions, the coroutine is resumed after
+    // the second one.
+    // In a chain, the timeout is linked to the next operation instead. An operation failing with a hard link must not
+    // end the rest of the chain, so it is hard-linked to its timeout.
+    Async::CompletionResult* result = std::visit([](const Async::OperationBase& op) { return op.result; }, next);
+    if (!result || !result->hasTimeout()) {
+        sqe->flags |= linkFlags;
+        return;
+    }
+
+    sqe->flags |= (linkFlags & IOSQE_IO_HARDLINK) ? IOSQE_IO_HARDLINK : IOSQE_IO_LINK;
+    result->pendingCompletions = 2;
+
+    io_uring_sqe* timeoutSqe = io_uring_get_sqe(&ring);
+    io_uring_prep_link_timeout(timeoutSqe, &result->timeout, 0);
+    io_uring_sqe_set_data(timeoutSqe, makeLinkedTimeoutTag(result));
+    timeoutSqe->flags |= linkFlags;
+}
+
+void addProvidedBuffer(io_uring_buf_ring* bufRing, char* bufMemory, unsigned short id) {
+    io_uring_buf_ring_add(bufRing, bufMemory + id * providedBufferSize, providedBufferSize, id,
+        io_uring_buf_ring_mask(numProvidedBuffers), 0);
+}
+
+void armWakeRead(io_uring& ring, int wakeFd, std::uint64_t& wakeValue) {
+    // Reading the eventfd resets its counter, and the completion wakes up a thread waiting on the ring
+    io_uring_sqe* sqe = io_uring_get_sqe(&ring);
+    io_uring_prep_read(sqe, wakeFd, &wakeValue, sizeof(wakeValue), 0);
+    io_uring_sqe_set_data(sqe, &wakeValue);
 }
 
-Async::EventLoop::EventLoop(unsigned int, unsigned int queueEntries) {
+Async::EventLoop::EventLoop(unsigned int, const Config& config) {
+    // eventfd used to interrupt waits, read through either backend
+    wakeFd = check(eventfd(0, EFD_CLOEXEC));
+
+    if (config.backend == Backend::Epoll) {
+        epoll = std::make_unique<EpollBackend>(wakeFd);
+        return;
+    }
+
+    // Queue sizes above the kernel's limits are clamped instead of failing
+    unsigned int flags = IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_CLAMP;
+
+    // The completion queue is sized separately since multishot operations can post many completions per submission
+    if (config.completionEntries > 0) flags |= IORING_SETUP_CQSIZE;
+
+    // With submission queue polling, a kernel thread picks up submissions so they don't need a syscall
+    if (config.sqPoll) {
+        flags |= IORING_SETUP_SQPOLL;
+        if (config.sqPollCPU >= 0) flags |= IORING_SETUP_SQ_AFF;
+    }
+
+    int wqFd = sharedWqFd.load();
+    switch (config.setupProfile) {
+        case SetupProfile::Throughput:
+            // Deferred task running can't be used with submission queue polling since the polling thread would have to
+            // run the completions
+            if (config.sqPoll) flags |= IORING_SETUP_COOP_TASKRUN | IORING_SETUP_TASKRUN_FLAG;
+            else flags |= IORING_SETUP_DEFER_TASKRUN;
+
+            // With submission queue polling, attaching would also share the first ring's polling thread, which would
+            // then take every loop's submissions and ignore their CPU pinning
+            if (wqFd >= 0 && !config.sqPoll) flags |= IORING_SETUP_ATTACH_WQ;
+            break;
+        case SetupProfile::Latency:
+            // The flag tells when completions are waiting to be processed, they are then flushed when CQEs are peeked
+            flags |= IORING_SETUP_COOP_TASKRUN | IORING_SETUP_TASKRUN_FLAG;
+            break;
+        default:
+            break;
+    }
+
     io_uring_params params;
-    std::memset(&params, 0, sizeof(params));
-    params.flags = IORING_SETUP_SINGLE_ISSUER;
+    auto initRing = [&] {
+        std::memset(&params, 0, sizeof(params));
+        params.flags = flags;
+        params.cq_entries = config.completionEntries;
+        params.sq_thread_idle = config.sqPollIdle;
+        params.sq_thread_cpu = static_cast<std::uint32_t>(std::max(config.sqPollCPU, 0));
+        params.wq_fd = static_cast<std::uint32_t>(std::max(wqFd, 0));
+        return io_uring_queue_init_params(config.queueEntries, &ring, &params);
+    };
+
+    // Optional features in the order they are given up if setup fails (e.g., Linux 6.1 is needed for deferred task
+    // running, polling may need privileges on older kernels)
+    constexpr std::array optionalFlags{
+        IORING_SETUP_ATTACH_WQ,
+        IORING_SETUP_DEFER_TASKRUN,
+        IORING_SETUP_COOP_TASKRUN | IORING_SETUP_TASKRUN_FLAG,
+        IORING_SETUP_SQPOLL | IORING_SETUP_SQ_AFF,
+    };
+
+    int ret = initRing();
+    for (unsigned int i : optionalFlags) {
+        if (ret == 0) break;
+        if (!(flags & i)) continue;
+
+        flags &= ~i;
+        ret = initRing();
+    }
+
+    // Use epoll if io_uring is unavailable
+    if (ret < 0) {
+        epoll = std::make_unique<EpollBackend>(wakeFd);
+        return;
+    }
+
+    if (config.setupProfile != SetupProfile::Default) {
+        // Let the first ring's workers be shared
+        if (config.setupProfile == SetupProfile::Throughput) {
+            int noRing = -1;
+            sharedWqFd.compare_exchange_strong(noRing, ring.ring_fd);
+        }
+
+        // Registering the ring descriptor saves looking it up on every system call (requires Linux 5.18)
+        // System calls use the regular descriptor if this fails.
+        io_uring_register_ring_fd(&ring);
+    }
+
+    // Operations without a completion result don't need a CQE unless they fail
+    if (params.features & IORING_FEAT_CQE_SKIP) fireAndForgetFlags = IOSQE_CQE_SKIP_SUCCESS;
+
+    // Submitted on the next iteration
+    armWakeRead(ring, wakeFd, wakeValue);
+    wakeReadArmed = true;
+
+    // Zero-copy sends require Linux 6.0
+    if (config.zeroCopyThreshold > 0) {
+        if (io_uring_probe* probe = io_uring_get_probe_ring(&ring)) {
+            if (io_uring_opcode_supported(probe, IORING_OP_SEND_ZC)) zeroCopyThreshold = config.zeroCopyThreshold;
+            io_uring_free_probe(probe);
+        }
+    }
+
+    // Set up a sparse fixed file table (requires Linux 5.19)
+    // Sockets are not registered if this fails.
+    if (io_uring_register_files_sparse(&ring, numFixedFiles) == 0) {
+        hasFixedFiles = true;
 
-    check(io_uring_queue_init_params(queueEntries, &ring, &params), checkZero, useReturnCodeNeg);
+        // Hand out the lowest slots first
+        freeFixedSlots.resize(numFixedFiles);
+        for (unsigned int i = 0; i < numFixedFiles; i++) freeFixedSlots[i] = numFixedFiles - i - 1;
+    }
+
+    // Set up the provided buffer ring (requires Linux 5.19)
+    // Receive operations fall back to their own buffers if this fails.
+    bufRing = io_uring_setup_buf_ring(&ring, numProvidedBuffers, bufferGroupID, 0, &ret);
+    if (!bufRing) return;
+
+    bufMemory = std::make_unique_for_overwrite<char[]>(numProvidedBuffers * providedBufferSize);
+    for (unsigned short i = 0; i < numProvidedBuffers; i++) addProvidedBuffer(bufRing, bufMemory.get(), i);
+
+    io_uring_buf_ring_advance(bufRing, numProvidedBuffers);
 }
 
 Async::EventLoop::~EventLoop() {
+    close(wakeFd);
+    if (epoll) return;
+
+    // Later event loops can't attach to this ring once it is closed
+    int ringFd = ring.ring_fd;
+    sharedWqFd.compare_exchange_strong(ringFd, -1);
+
+    if (bufRing) io_uring_free_buf_ring(&ring, bufRing, numProvidedBuffers, bufferGroupID);
     io_uring_queue_exit(&ring);
 }
 
-void Async::EventLoop::runOnce(bool wait) {
-    __kernel_timespec timeout{ 0, wait ? 200000000 : 0 };
+void Async::EventLoop::runIO(std::chrono::milliseconds timeout) {
+    if (epoll) {
+        runIOEpoll(timeout);
+        return;
+    }
+
+    // Failed fire-and-forget operations may still have CQEs to be reaped
+    // The loop also waits while only timers are armed, its wakeup read is always pending.
+    if (operations.empty() && deferredOperations.empty() && numOperations == 0 && io_uring_cq_ready(&ring) == 0
+        && timers.empty())
+        return;
+
+    auto seconds = std::chrono::duration_cast<std::chrono::seconds>(timeout);
+    __kernel_timespec waitTime{ seconds.count(), std::chrono::nanoseconds{ timeout - seconds }.count() };
     io_uring_cqe* cqe = nullptr;
 
-    if (operations.empty()) {
-        if (numOperations == 0) return;
+    // Operations are deferred while the completion queue has overflowed since their completions would add to the
+    // backlog in the kernel. They are also deferred when the submission queue is full. Once an operation is deferred,
+    // the ones after it are too so they are submitted in order.
+    bool cqOverflow = io_uring_cq_has_overflow(&ring);
+    auto submitOperation = [this, cqOverflow](const Operation& op) {
+        if (cqOverflow || !reserveSqes(ring, getNumSqes(op))) return false;
+
+        // Slots are cleared before a chain starts since its SQEs must be consecutive
+        forEachOperation(op, [this](const Operation& i) {
+            if (auto close = std::get_if<Close>(&i)) unregisterFile(close->handle);
+        });
+
+        handleOperation(ring, op, fireAndForgetFlags, fixedFiles);
+
+        // Only operations with a completion result are waited on
+        numOperations += numResults(op);
+        return true;
+    };
+
+    // Retry operations deferred on previous iterations
+    while (!deferredOperations.empty() && submitOperation(deferredOperations.front())) deferredOperations.pop_front();
+
+    // There are queued operations, process them
+    operations.drain([this, &submitOperation](const Operation& op) {
+        if (!deferredOperations.empty() || !submitOperation(op)) deferredOperations.push_back(op);
+    });
+
+    // Re-arm the wakeup read if it completed
+    if (!wakeReadArmed && reserveSqes(ring, 1)) {
+        armWakeRead(ring, wakeFd, wakeValue);
+        wakeReadArmed = true;
+    }
+
+    // Deferred operations are retried as soon as completions make room for them
+    if (!deferredOperations.empty()) waitTime = {};
+
+    // Submit to io_uring (including a re-armed wakeup read) and wait for next CQE
+    // The wait ends early when another thread calls interrupt(). Submissions fail with EBUSY while the completion
+    // queue has overflowed, in which case the CQEs are harvested to make room.
+    int ret = io_uring_submit_and_wait_timeout(&ring, &cqe, 1, &waitTime, nullptr);
+    if (ret < 0 && ret != -EBUSY) return;
+
+    // Harvest every ready CQE in batches. The completions are copied out before the CQ ring is advanced (after which
+    // the kernel may reuse the entries), then handled in order. Each one resumes its coroutine before the next is
+    // handled since multishot operations can have several completions in the same batch.
+    std::array<io_uring_cqe*, cqeBatchSize> cqes;
+    std::array<Completion, cqeBatchSize> completions;
+
+    while (unsigned int count = io_uring_peek_batch_cqe(&ring, cqes.data(), cqeBatchSize)) {
+        for (unsigned int i = 0; i < count; i++)
+            completions[i] = { io_uring_cqe_get_data(cqes[i]), cqes[i]->res, cqes[i]->flags };
+
+        io_uring_cq_advance(&ring, count);
+
+        for (const auto& [userData, res, flags] : std::span{ completions.data(), count }) {
+            // Wakeups have no associated coroutine, they only need to end the wait
+            if (userData == &wakeValue) {
+                wakeReadArmed = false;
+                continue;
+            }
+
+            // Fixed file slots can be reused once they have been cleared
+            if (auto slot = getReleasedSlot(userData)) {
+                freeFixedSlots.push_back(*slot);
+                continue;
+            }
 
-        if (io_uring_wait_cqe_timeout(&ring, &cqe, &timeout) < 0) return;
-    } else {
-        // There are queued operations, process them
-        for (const auto& i : operations) handleOperation(ring, i);
-        numOperations += operations.size();
-        operations.clear();
+            CompletionResult* result = getLinkedTimeoutResult(userData);
+            if (result) {
+                // The timeout canceled the operation if it expired
+                if (res == -ETIME) result->timedOut = true;
+            } else {
+                // Fire-and-forget operations have no completion result
+                result = static_cast<CompletionResult*>(userData);
+                if (!result) continue;
 
-        // Submit to io_uring and wait for next CQE
-        if (io_uring_submit_and_wait_timeout(&ring, &cqe, 1, &timeout, nullptr) < 0) return;
+                // Fill in completion result information
+                // Zero-copy send notifications only signal that the buffer was released, the send result is kept.
+                if (!(flags & IORING_CQE_F_NOTIF)) {
+                    if (res < 0) result->error = -res;
+                    else result->res = res;
+                }
+
+                result->flags = flags;
+
+                // Multishot operations stay active while they indicate more completions
+                if (flags & IORING_CQE_F_MORE) {
+                    result->coroHandle();
+                    continue;
+                }
+            }
+
+            // Wait for the other completion of an operation with a linked timeout
+            if (--result->pendingCompletions > 0) continue;
+
+            // Report operations canceled by their timeouts as timed out
+            if (result->timedOut && result->error == ECANCELED) result->error = ETIMEDOUT;
+
+            numOperations--;
+            result->coroHandle();
+        }
+
+        // A partial batch means the completion queue has been drained
+        if (count < cqeBatchSize) break;
     }
+}
+
+unsigned int Async::EventLoop::getNumSqes(const Operation& op) const {
+    unsigned int numSqes = 0;
 
-    if (!cqe) return;
+    forEachOperation(op, [this, &numSqes](const Operation& i) {
+        numSqes++;
 
-    void* userData = io_uring_cqe_get_data(cqe);
-    io_uring_cqe_seen(&ring, cqe);
-    numOperations--;
+        // Linked timeout
+        CompletionResult* result = std::visit([](const OperationBase& j) { return j.result; }, i);
+        if (result && result->hasTimeout()) numSqes++;
+
+        // Clearing the fixed file slot of a closed socket
+        if (auto close = std::get_if<Close>(&i); close && fixedFiles.contains(close->handle)) numSqes++;
+    });
+
+    return numSqes;
+}
+
+void Async::EventLoop::unregisterFile(int fd) {
+    auto it = fixedFiles.find(fd);
+    if (it == fixedFiles.end()) return;
+
+    // The slot is cleared by an operation queued before the close. Operations queued earlier take their references to
+    // the file when they are issued, which happens in order (possibly later in a polling kernel thread), so a
+    // synchronous update here could clear the slot too early. The slot is only reused after the update completes.
+    io_uring_sqe* sqe = io_uring_get_sqe(&ring);
+    io_uring_prep_files_update(sqe, &noFile, 1, static_cast<int>(it->second));
+    io_uring_sqe_set_data(sqe, makeReleasedSlotTag(it->second));
+
+    // New operations on the descriptor number (e.g., after it is reused for another socket) use the regular descriptor
+    fixedFiles.erase(it);
+}
+
+bool Async::EventLoop::registerFile(int fd) {
+    if (!hasFixedFiles || freeFixedSlots.empty() || fixedFiles.contains(fd)) return false;
+
+    unsigned int slot = freeFixedSlots.back();
+    if (io_uring_register_files_update(&ring, slot, &fd, 1) != 1) return false;
+
+    freeFixedSlots.pop_back();
+    fixedFiles.emplace(fd, slot);
+    return true;
+}
+
+void Async::EventLoop::interrupt() {
+    eventfd_write(wakeFd, 1);
+}
+
+std::size_t Async::EventLoop::getProvidedBufferSize() const {
+    return bufRing ? providedBufferSize : 0;
+}
 
-    if (!userData) return;
+std::string Async::EventLoop::consumeProvidedBuffer(const CompletionResult& result) {
+    // No buffer is selected if the operation failed or received nothing
+    if (!(result.flags & IORING_CQE_F_BUFFER)) return "";
 
-    // Fill in completion result information
-    auto& result = *reinterpret_cast<CompletionResult*>(userData);
-    if (cqe->res < 0) result.error = -cqe->res;
-    else result.res = cqe->res;
+    auto id = static_cast<unsigned short>(result.flags >> IORING_CQE_BUFFER_SHIFT);
+    std::string data{ bufMemory.get() + id * providedBufferSize, static_cast<std::size_t>(result.res) };
 
-    result.coroHandle();
+    addProvidedBuffer(bufRing, bufMemory.get(), id);
+    io_uring_buf_ring_advance(bufRing, 1);
+    return data;
 }
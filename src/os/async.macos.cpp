@@ -4,10 +4,12 @@
 #include "async.hpp"
 
 #include <cerrno>
+#include <chrono>
 #include <coroutine>
 #include <cstdint>
 #include <ctime>
 #include <variant>
+#include <vector>
 
 #include <sys/event.h>
 #include <sys/fcntl.h>
@@ -30,7 +32,14 @@ std::uint64_t getMapID(int s, std::int16_t filt) {
     return static_cast<std::uint64_t>(s) | filterBit;
 }
 
-Async::EventLoop::EventLoop(unsigned int, unsigned int) : kq(check(kqueue())) {}
+Async::EventLoop::EventLoop(unsigned int, const Config&) : kq(check(kqueue())) {
+    // User event to interrupt waits from other threads
+    struct kevent event {
+        0, EVFILT_USER, EV_ADD | EV_CLEAR, 0, 0, nullptr
+    };
+
+    check(kevent(kq, &event, 1, nullptr, 0, nullptr));
+}
 
 Async::EventLoop::~EventLoop() {
     close(kq);
@@ -58,14 +67,15 @@ void handleOperation(Async::PendingEventsMap& pendingEvents, std::vector<struct
         [&](const Async::Cancel& op) {
             for (std::int16_t filt : { EVFILT_READ, EVFILT_WRITE }) {
                 std::uint64_t mapID = getMapID(op.handle, filt);
-                if (!pendingEvents.contains(mapID)) continue;
+                auto it = pendingEvents.find(mapID);
+                if (it == pendingEvents.end() || (op.target && it->second != op.target)) continue;
 
                 // Cancelling means adding a kevent and removing a pending operation
                 events.push_back({ static_cast<std::uintptr_t>(op.handle), filt, EV_DELETE, 0, 0, nullptr });
                 numOperations--;
 
-                auto& result = *pendingEvents[mapID];
-                pendingEvents.erase(mapID);
+                auto& result = *it->second;
+                pendingEvents.erase(it);
                 result.error = ECANCELED;
                 result.coroHandle();
             }
@@ -75,18 +85,17 @@ void handleOperation(Async::PendingEventsMap& pendingEvents, std::vector<struct
     std::visit(visitor, next);
 }
 
-void Async::EventLoop::runOnce(bool wait) {
+void Async::EventLoop::runIO(std::chrono::milliseconds timeout) {
     if (operations.empty()) {
-        if (numOperations == 0) return;
+        if (numOperations == 0 && timers.empty()) return;
     } else {
         std::vector<struct kevent> events;
 
-        for (const auto& i : operations) handleOperation(pendingEvents, events, i, numOperations);
-        operations.clear();
+        operations.drain([&](const Operation& op) { handleOperation(pendingEvents, events, op, numOperations); });
 
         // Submit pending events from queue
-        timespec timeout{ 0, 0 };
-        if (kevent(kq, events.data(), events.size(), events.data(), events.size(), &timeout) == 0) return;
+        timespec noWait{ 0, 0 };
+        if (kevent(kq, events.data(), events.size(), events.data(), events.size(), &noWait) == 0) return;
 
         for (const auto& i : events) {
             // Get events that set error status
@@ -105,10 +114,14 @@ void Async::EventLoop::runOnce(bool wait) {
 
     struct kevent event {};
 
-    timespec timeout{ 0, wait ? 200000000 : 0 };
+    auto seconds = std::chrono::duration_cast<std::chrono::seconds>(timeout);
+    timespec waitTime{ seconds.count(), std::chrono::nanoseconds{ timeout - seconds }.count() };
 
     // Wait for one event from kqueue
-    if (kevent(kq, nullptr, 0, &event, 1, &timeout) <= 0) return;
+    if (kevent(kq, nullptr, 0, &event, 1, &waitTime) <= 0) return;
+
+    // Wakeups have no associated coroutine, they only need to end the wait
+    if (event.filter == EVFILT_USER) return;
     numOperations--;
 
     // Pop an event from the map and get its completion result
@@ -122,6 +135,14 @@ void Async::EventLoop::runOnce(bool wait) {
     result.coroHandle();
 }
 
+void Async::EventLoop::interrupt() {
+    struct kevent event {
+        0, EVFILT_USER, 0, NOTE_TRIGGER, 0, nullptr
+    };
+
+    kevent(kq, &event, 1, nullptr, 0, nullptr);
+}
+
 void Async::prepSocket(int s) {
     int flags = check(fcntl(s, F_GETFL, 0));
     check(fcntl(s, F_SETFL, flags | O_NONBLOCK));
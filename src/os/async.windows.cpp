@@ -3,6 +3,7 @@
 
 #include "async.hpp"
 
+#include <chrono>
 #include <mutex>
 #include <thread>
 #include <unordered_map>
@@ -81,7 +82,11 @@ void handleOperation(const Async::Operation& operation) {
         },
         [=](const Async::Shutdown& op) { shutdown(op.handle, SD_BOTH); },
         [=](const Async::Close& op) { closesocket(op.handle); },
-        [=](const Async::Cancel& op) { CancelIo(reinterpret_cast<HANDLE>(op.handle)); },
+        [=](const Async::Cancel& op) {
+            // CancelIoEx is needed to cancel a specific operation, which may have been started on any thread
+            if (op.target) CancelIoEx(reinterpret_cast<HANDLE>(op.handle), op.target);
+            else CancelIo(reinterpret_cast<HANDLE>(op.handle));
+        },
     };
 
     try {
@@ -95,7 +100,7 @@ void handleOperation(const Async::Operation& operation) {
     }
 }
 
-Async::EventLoop::EventLoop(unsigned int numThreads, unsigned int) : thisId(std::this_thread::get_id()) {
+Async::EventLoop::EventLoop(unsigned int numThreads, const Config&) : thisId(std::this_thread::get_id()) {
     std::scoped_lock lock{ runningMutex };
 
     // Initialization and cleanup happen on the first thread that is initialized
@@ -127,7 +132,7 @@ Async::EventLoop::~EventLoop() {
     }
 }
 
-void Async::EventLoop::runOnce(bool wait) {
+void Async::EventLoop::runIO(std::chrono::milliseconds timeout) {
     // Check for submits from other threads
     std::vector<std::coroutine_handle<>> tmp;
     {
@@ -139,20 +144,18 @@ void Async::EventLoop::runOnce(bool wait) {
     numOperations -= tmp.size();
     for (auto i : tmp) i();
 
-    if (!operations.empty()) {
-        for (const auto& i : operations) handleOperation(i);
-        numOperations += operations.size();
-        operations.clear();
-    }
+    operations.drain([this](const Operation& op) {
+        handleOperation(op);
+        numOperations++;
+    });
 
     DWORD numBytes;
     ULONG_PTR completionKey;
     LPOVERLAPPED overlapped = nullptr;
 
     // Dequeue a completion packet from the system and check for the exit condition
-    // Shorter timeout than on other platforms - threads need to handle events that are not from IOCP.
-    DWORD timeout = wait ? 20 : 0;
-    BOOL ret = GetQueuedCompletionStatus(completionPort, &numBytes, &completionKey, &overlapped, timeout);
+    auto waitTime = static_cast<DWORD>(timeout.count());
+    BOOL ret = GetQueuedCompletionStatus(completionPort, &numBytes, &completionKey, &overlapped, waitTime);
 
     // Get the structure with completion data, passed through the overlapped pointer
     // No locking is needed to modify the structure's fields - the calling coroutine will be suspended at this
@@ -177,6 +180,11 @@ void Async::EventLoop::runOnce(bool wait) {
     }
 }
 
+void Async::EventLoop::interrupt() {
+    // The completion port is shared between threads so a posted packet can't target a specific thread.
+    // Waits in runOnce are kept short instead.
+}
+
 void Async::add(SOCKET s) {
     check(CreateIoCompletionPort(reinterpret_cast<HANDLE>(s), completionPort, 0, 0), checkTrue);
 }
@@ -114,3 +114,11 @@ bool System::SystemError::isCanceled() const {
 
     return false;
 }
+
+bool System::SystemError::isTimedOut() const {
+#if OS_WINDOWS
+    return type == System::ErrorType::System && code == WSAETIMEDOUT;
+#else
+    return type == System::ErrorType::System && code == ETIMEDOUT;
+#endif
+}
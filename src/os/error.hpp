@@ -52,5 +52,8 @@ namespace System {
 
         // Checks if this exception represents a canceled operation.
         bool isCanceled() const;
+
+        // Checks if this exception represents an operation that exceeded its time limit.
+        bool isTimedOut() const;
     };
 }
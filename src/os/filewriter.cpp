@@ -0,0 +1,118 @@
+// Copyright 2021-2024 Aidan Sun and the WhaleConnect contributors
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "filewriter.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "async.hpp"
+#include "errcheck.hpp"
+#include "error.hpp"
+#include "utils/task.hpp"
+
+#if OS_LINUX
+#include <fcntl.h>
+#include <unistd.h>
+#else
+#include <fstream>
+#endif
+
+struct FileWriter::State {
+#if OS_LINUX
+    int fd;
+#else
+    std::ofstream file;
+#endif
+
+    std::string pending; // Data waiting to be written
+    std::string inFlight; // Data being written, swapped with the pending data to reuse both buffers
+    bool writing = false;
+    std::uint64_t numWritten = 0;
+    std::uint64_t numDropped = 0;
+    std::optional<std::string> error;
+
+#if OS_LINUX
+    explicit State(const std::string& path) :
+        fd(check(open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644))) {}
+
+    ~State() {
+        close(fd);
+    }
+#else
+    explicit State(const std::string& path) : file(path, std::ios::binary | std::ios::app) {
+        if (!file) throw System::SystemError{ System::getLastError(), System::ErrorType::System };
+    }
+#endif
+
+    State(const State&) = delete;
+
+    State& operator=(const State&) = delete;
+};
+
+FileWriter::FileWriter(const std::string& path) : state(std::make_shared<State>(path)) {}
+
+Task<> FileWriter::writePending(std::shared_ptr<State> state) try {
+    state->writing = true;
+
+    while (!state->pending.empty()) {
+        state->inFlight.swap(state->pending);
+        std::string_view data = state->inFlight;
+
+#if OS_LINUX
+        // Writes to regular files are only cut short by errors, but any remaining data is written again to be sure
+        while (!data.empty()) {
+            auto result = co_await Async::run([&data, fd = state->fd](Async::CompletionResult& result) {
+                Async::submit(Async::Write{ { fd, &result }, data });
+            });
+
+            data.remove_prefix(static_cast<std::size_t>(result.res));
+            state->numWritten += static_cast<std::uint64_t>(result.res);
+        }
+#else
+        co_await Async::runBlocking([&state, data] {
+            if (!state->file.write(data.data(), static_cast<std::streamsize>(data.size())).flush())
+                throw System::SystemError{ System::getLastError(), System::ErrorType::System };
+        });
+
+        state->numWritten += data.size();
+#endif
+
+        state->inFlight.clear();
+    }
+
+    state->writing = false;
+} catch (const System::SystemError& error) {
+    // Data given after a failure is not kept
+    state->error = error.what();
+    state->pending.clear();
+    state->pending.shrink_to_fit();
+}
+
+void FileWriter::write(std::string_view data) {
+    if (state->error) return;
+
+    if (state->pending.size() + data.size() > maxPending) {
+        state->numDropped += data.size();
+        return;
+    }
+
+    state->pending += data;
+    if (!state->writing) writePending(state);
+}
+
+std::uint64_t FileWriter::getNumWritten() const {
+    return state->numWritten;
+}
+
+std::uint64_t FileWriter::getNumDropped() const {
+    return state->numDropped;
+}
+
+const std::optional<std::string>& FileWriter::getError() const {
+    return state->error;
+}
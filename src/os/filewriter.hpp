@@ -0,0 +1,47 @@
+// Copyright 2021-2024 Aidan Sun and the WhaleConnect contributors
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "utils/task.hpp"
+
+// Appends data to a file without blocking the thread it comes from.
+//
+// Data is written in the order it is given, one write at a time. Data given while a write is in progress is gathered
+// and written with the next one, so fast sources are written in large batches. On Linux, writes go through the current
+// thread's event loop. On other platforms, they run on a separate thread (see Async::runBlocking).
+class FileWriter {
+    struct State;
+
+    // Most data waiting to be written, any more is dropped if the disk can't keep up
+    static constexpr std::size_t maxPending = 64 * 1024 * 1024;
+
+    // Shared with the write in progress so the remaining data is still written after the writer is destroyed
+    std::shared_ptr<State> state;
+
+    // Writes the data waiting to be written until there is none left or a write fails.
+    static Task<> writePending(std::shared_ptr<State> state);
+
+public:
+    // Opens a file to append to, creating it if it doesn't exist. Throws a System::SystemError on failure.
+    explicit FileWriter(const std::string& path);
+
+    // Adds data to be written to the end of the file.
+    void write(std::string_view data);
+
+    // Gets the number of bytes written to the file.
+    std::uint64_t getNumWritten() const;
+
+    // Gets the number of bytes dropped because too much data was waiting to be written.
+    std::uint64_t getNumDropped() const;
+
+    // Gets the error that stopped writing, if there was one.
+    const std::optional<std::string>& getError() const;
+};
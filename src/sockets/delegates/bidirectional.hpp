@@ -4,7 +4,10 @@
 #pragma once
 
 #include <cstdint>
+#include <stop_token>
 #include <string>
+#include <string_view>
+#include <utility>
 
 #include "delegates.hpp"
 #include "sockethandle.hpp"
@@ -19,8 +22,52 @@ namespace Delegates {
     public:
         explicit Bidirectional(SocketHandle<Tag>& handle) : handle(handle) {}
 
-        Task<> send(std::string data) override;
+        Task<> send(std::string_view data) override;
 
-        Task<RecvResult> recv(std::size_t size) override;
+        Task<> sendSegmented(std::string data, std::size_t segmentSize) override;
+
+        Task<RecvResult> recv(std::size_t size, std::stop_token stopToken) override;
+
+        Task<RecvResult> sendRecv(std::string_view data, std::size_t size) override;
+
+        Task<> recvStream(std::size_t size, RecvHandler handler) override;
+
+        Task<> sendFile(std::string path, SendFileHandler handler) override;
+
+        Task<> relay(IODelegate& target, std::size_t sampleSize, RelayHandler handler,
+            std::stop_token stopToken) override;
     };
 }
+
+#if !OS_LINUX
+// Without a platform-specific implementation, each message is sent with its own operation
+template <auto Tag>
+Task<> Delegates::Bidirectional<Tag>::sendSegmented(std::string data, std::size_t segmentSize) {
+    co_await sendEachSegment(*this, data, segmentSize);
+}
+
+// Requests and their responses are sent and received with separate operations
+template <auto Tag>
+Task<RecvResult> Delegates::Bidirectional<Tag>::sendRecv(std::string_view data, std::size_t size) {
+    co_return co_await sendThenRecv(*this, data, size);
+}
+
+// Data is also received with one operation at a time
+template <auto Tag>
+Task<> Delegates::Bidirectional<Tag>::recvStream(std::size_t size, RecvHandler handler) {
+    co_await recvEach(*this, size, handler);
+}
+
+// Files are read into memory one part at a time
+template <auto Tag>
+Task<> Delegates::Bidirectional<Tag>::sendFile(std::string path, SendFileHandler handler) {
+    co_await sendEachPart(*this, path, handler);
+}
+
+// Relayed data is received into memory one part at a time
+template <auto Tag>
+Task<> Delegates::Bidirectional<Tag>::relay(IODelegate& target, std::size_t sampleSize, RelayHandler handler,
+    std::stop_token stopToken) {
+    co_await relayEach(*this, target, sampleSize, handler, stopToken);
+}
+#endif
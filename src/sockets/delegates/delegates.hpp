@@ -3,10 +3,18 @@
 
 #pragma once
 
+#include <chrono>
 #include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <functional>
 #include <memory>
 #include <optional>
+#include <stop_token>
 #include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
 
 #include "net/device.hpp"
 #include "net/enums.hpp"
@@ -28,16 +36,31 @@ struct RecvResult {
     std::optional<TLSAlert> alert;
 };
 
+// Function called with each result of a continuous receive.
+using RecvHandler = std::function<void(RecvResult)>;
+
+// Function called with the number of bytes sent by each part of a file.
+using SendFileHandler = std::function<void(std::size_t)>;
+
+// Function called with the number of bytes in each part of relayed data and a sample from the start of the part.
+using RelayHandler = std::function<void(std::size_t, std::string)>;
+
 struct AcceptResult {
     Device device;
     SocketPtr socket;
 };
 
+// Function called with each client accepted by a server.
+using AcceptHandler = std::function<void(AcceptResult)>;
+
 struct DgramRecvResult {
     Device from;
     std::string data;
 };
 
+// Function called with each datagram received by a server.
+using DgramRecvHandler = std::function<void(DgramRecvResult)>;
+
 struct ServerAddress {
     std::uint16_t port = 0;
     IPType ipType = IPType::None;
@@ -56,20 +79,111 @@ namespace Delegates {
 
         // Cancels all pending I/O.
         virtual void cancelIO() = 0;
+
+        // Sets the time limit of each subsequent connect, accept, send, and receive operation (zero for none).
+        // Operations that exceed it fail with a timeout error. Only supported on Linux.
+        virtual void setTimeout(std::chrono::milliseconds timeout) = 0;
     };
 
     // Manages I/O operations.
     struct IODelegate {
         virtual ~IODelegate() = default;
 
-        // Sends a string.
-        // The data is passed as a string to make a copy and prevent dangling pointers in the coroutine.
-        virtual Task<> send(std::string data) = 0;
+        // Sends a string. The data isn't copied, so it must stay valid until the task finishes.
+        virtual Task<> send(std::string_view data) = 0;
+
+        // Sends data as messages of the given size, the last one may be shorter. On UDP sockets, each message is a
+        // datagram, and many of them are sent at once where the platform supports it.
+        virtual Task<> sendSegmented(std::string data, std::size_t segmentSize) = 0;
+
+        // Receives a string. Only this operation is canceled if a stop is requested through the stop token.
+        virtual Task<RecvResult> recv(std::size_t size, std::stop_token stopToken) = 0;
 
-        // Receives a string.
-        virtual Task<RecvResult> recv(std::size_t size) = 0;
+        // Sends a string, then receives a string of at most the given size (e.g., a request and its response). Where
+        // the platform supports it, both operations are started at once, the receive beginning after the send. As with
+        // send, the data must stay valid until the task finishes.
+        virtual Task<RecvResult> sendRecv(std::string_view data, std::size_t size) = 0;
+
+        // Receives continuously, calling a function with each result of at most the given size, until the connection
+        // is closed. The last result passed to the function indicates the closure.
+        virtual Task<> recvStream(std::size_t size, RecvHandler handler) = 0;
+
+        // Sends the contents of a file without loading all of it into memory, calling a function with the size of each
+        // part sent.
+        virtual Task<> sendFile(std::string path, SendFileHandler handler) = 0;
+
+        // Forwards data received on this socket to another one until the connection is closed, calling a function with
+        // each part forwarded and a sample of at most the given size from it. Sending is shut down on the other socket
+        // afterward if possible, so its peer sees the end of the data.
+        virtual Task<> relay(IODelegate& target, std::size_t sampleSize, RelayHandler handler,
+            std::stop_token stopToken) = 0;
     };
 
+    // Checks if a receive result ends a connection.
+    inline bool endsConnection(const RecvResult& result) {
+        return result.closed || (result.alert && result.alert->isFatal);
+    }
+
+    // Receives with one operation at a time, calling a function with each result until the connection is closed.
+    // Used by delegates without a more efficient way to receive continuously.
+    inline Task<> recvEach(IODelegate& io, std::size_t size, const RecvHandler& handler) {
+        while (true) {
+            auto result = co_await io.recv(size, {});
+            bool ended = endsConnection(result);
+
+            handler(std::move(result));
+            if (ended) co_return;
+        }
+    }
+
+    // Sends data as messages of the given size with one operation for each. Used by delegates without a way to send
+    // many messages at once.
+    inline Task<> sendEachSegment(IODelegate& io, const std::string& data, std::size_t segmentSize) {
+        if (segmentSize == 0) segmentSize = data.size();
+
+        for (std::size_t i = 0; i < data.size(); i += segmentSize) co_await io.send(data.substr(i, segmentSize));
+    }
+
+    // Sends, then receives with separate operations. Used by delegates without a way to link operations.
+    inline Task<RecvResult> sendThenRecv(IODelegate& io, std::string_view data, std::size_t size) {
+        if (!data.empty()) co_await io.send(data);
+        co_return co_await io.recv(size, {});
+    }
+
+    // Sends a file by reading it into a buffer and sending it one part at a time, calling a function with the size of
+    // each part. Used by delegates without a way to send files from the kernel.
+    inline Task<> sendEachPart(IODelegate& io, const std::string& path, const SendFileHandler& handler) {
+        constexpr std::size_t partSize = 64 * 1024;
+
+        std::ifstream file{ std::filesystem::path{ path }, std::ios::binary };
+        if (!file) throw std::system_error{ std::make_error_code(std::errc::no_such_file_or_directory), path };
+
+        std::string part(partSize, 0);
+        while (file.read(part.data(), static_cast<std::streamsize>(partSize)) || file.gcount() > 0) {
+            auto size = static_cast<std::size_t>(file.gcount());
+
+            co_await io.send(part.substr(0, size));
+            handler(size);
+        }
+
+        if (file.bad()) throw std::system_error{ std::make_error_code(std::errc::io_error), path };
+    }
+
+    // Relays data by receiving it into a buffer and sending it one part at a time. Used by delegates without a way to
+    // relay data within the kernel.
+    inline Task<> relayEach(IODelegate& source, IODelegate& target, std::size_t sampleSize, const RelayHandler& handler,
+        std::stop_token stopToken) {
+        constexpr std::size_t partSize = 64 * 1024;
+
+        while (true) {
+            auto result = co_await source.recv(partSize, stopToken);
+            if (endsConnection(result)) break;
+
+            co_await target.send(result.data);
+            handler(result.data.size(), result.data.substr(0, sampleSize));
+        }
+    }
+
     // Manages client operations.
     struct ClientDelegate {
         virtual ~ClientDelegate() = default;
@@ -88,10 +202,22 @@ namespace Delegates {
         // Accepts a client connection.
         virtual Task<AcceptResult> accept() = 0;
 
+        // Accepts client connections continuously, calling a function with each one, until the operation is canceled
+        // or fails.
+        virtual Task<> acceptStream(AcceptHandler handler) = 0;
+
         // Receives data from a connectionless client.
         virtual Task<DgramRecvResult> recvFrom(std::size_t size) = 0;
 
+        // Receives data from connectionless clients continuously, calling a function with each datagram (truncated to
+        // the given size), until the operation is canceled or fails.
+        virtual Task<> recvFromStream(std::size_t size, DgramRecvHandler handler) = 0;
+
         // Sends data to a connectionless client.
         virtual Task<> sendTo(Device device, std::string data) = 0;
+
+        // Sends data to a connectionless client as datagrams of the given size, the last one may be shorter. Many of
+        // them are sent at once where the platform supports it.
+        virtual Task<> sendToSegmented(Device device, std::string data, std::size_t segmentSize) = 0;
     };
 }
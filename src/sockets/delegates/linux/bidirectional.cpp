@@ -3,26 +3,100 @@
 
 #include "sockets/delegates/bidirectional.hpp"
 
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <exception>
+#include <optional>
+#include <stop_token>
 #include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "net/enums.hpp"
 #include "os/async.hpp"
+#include "os/errcheck.hpp"
+#include "os/error.hpp"
+#include "sockets/delegates/linux/udpoffload.hpp"
+#include "sockets/delegates/sockethandle.hpp"
 #include "utils/task.hpp"
 
+// Registers a socket in the fixed file table of the thread performing its I/O. Sockets can be handed to another thread
+// after they are set up (e.g., accepted on the main thread and served by a worker), so this is done when their
+// operations start instead of when they are created. Registering is skipped once the socket has a fixed file.
 template <auto Tag>
-Task<> Delegates::Bidirectional<Tag>::send(std::string data) {
-    co_await Async::run([this, &data](Async::CompletionResult& result) {
-        Async::submit(Async::Send{ { *handle, &result }, data });
-    });
+void registerOnThisThread(Delegates::SocketHandle<Tag>& handle) {
+    if constexpr (Tag == SocketTag::IP) handle.registerFixedFile();
+}
+
+template <auto Tag>
+Task<> Delegates::Bidirectional<Tag>::send(std::string_view data) {
+    registerOnThisThread(handle);
+
+    // Large sends skip copying the data into the kernel. The caller keeps the data alive until the kernel's
+    // notification that it is done with the buffer, which Async::run waits for.
+    std::size_t zeroCopyThreshold = Async::currentEventLoop().getZeroCopyThreshold();
+    bool zeroCopy = zeroCopyThreshold > 0 && data.size() >= zeroCopyThreshold;
+
+    co_await Async::run([this, &data, zeroCopy](Async::CompletionResult& result) {
+        if (zeroCopy) Async::submit(Async::SendZeroCopy{ { *handle, &result }, data });
+        else Async::submit(Async::Send{ { *handle, &result }, data });
+    }, System::ErrorType::System, handle.getTimeout());
 }
 
 template <auto Tag>
-Task<RecvResult> Delegates::Bidirectional<Tag>::recv(std::size_t size) {
+Task<> Delegates::Bidirectional<Tag>::sendSegmented(std::string data, std::size_t segmentSize) {
+    registerOnThisThread(handle);
+
+    // Connected UDP sockets hand many datagrams to the kernel at once, other sockets send each message separately
+    if constexpr (Tag == SocketTag::IP) {
+        int type = 0;
+        socklen_t typeLen = sizeof(type);
+
+        if (getsockopt(*handle, SOL_SOCKET, SO_TYPE, &type, &typeLen) == 0 && type == SOCK_DGRAM) {
+            co_await UDPOffload::send(handle, data, segmentSize, nullptr, 0);
+            co_return;
+        }
+    }
+
+    co_await sendEachSegment(*this, data, segmentSize);
+}
+
+template <auto Tag>
+Task<RecvResult> Delegates::Bidirectional<Tag>::recv(std::size_t size, std::stop_token stopToken) {
+    registerOnThisThread(handle);
+
+    // Let the kernel pick a buffer from the event loop's provided buffer ring once data arrives, so idle receives don't
+    // need memory. The buffer is recycled as soon as the data is copied out.
+    Async::EventLoop& eventLoop = Async::currentEventLoop();
+    if (size <= eventLoop.getProvidedBufferSize()) {
+        try {
+            auto recvResult = co_await Async::run([this, size](Async::CompletionResult& result) {
+                Async::submit(Async::ReceiveProvided{ { *handle, &result }, size });
+            }, System::ErrorType::System, handle.getTimeout(), stopToken);
+
+            // The buffer must be recycled even if the peer closed the connection (the kernel may still select one)
+            std::string data = eventLoop.consumeProvidedBuffer(recvResult);
+            if (recvResult.res == 0) co_return { true, true, "", std::nullopt };
+
+            co_return { true, false, data, std::nullopt };
+        } catch (const System::SystemError& e) {
+            // ENOBUFS means all provided buffers are in use, fall back to a dedicated buffer
+            if (e.code != ENOBUFS) throw;
+        }
+    }
+
     std::string data(size, 0);
 
     auto recvResult = co_await Async::run([this, &data](Async::CompletionResult& result) {
         Async::submit(Async::Receive{ { *handle, &result }, data });
-    });
+    }, System::ErrorType::System, handle.getTimeout(), stopToken);
 
     if (recvResult.res == 0) co_return { true, true, "", std::nullopt };
 
@@ -30,8 +104,255 @@ Task<RecvResult> Delegates::Bidirectional<Tag>::recv(std::size_t size) {
     co_return { true, false, data, std::nullopt };
 }
 
-template Task<> Delegates::Bidirectional<SocketTag::IP>::send(std::string);
-template Task<RecvResult> Delegates::Bidirectional<SocketTag::IP>::recv(std::size_t);
+template <auto Tag>
+Task<RecvResult> Delegates::Bidirectional<Tag>::sendRecv(std::string_view data, std::size_t size) {
+    registerOnThisThread(handle);
+
+    if (data.empty()) co_return co_await recv(size, {});
+
+    // The receive is linked to the send, so both are submitted together and the kernel starts the receive as soon as
+    // the send finishes. If the send fails, the receive is canceled.
+    std::string buf(size, 0);
+
+    auto results = co_await Async::runLinked<2>([this, &data, &buf](auto& results) {
+        return std::vector<Async::Operation>{
+            Async::Send{ { *handle, &results[0] }, data },
+            Async::Receive{ { *handle, &results[1] }, buf },
+        };
+    }, System::ErrorType::System, handle.getTimeout());
+
+    const auto& recvResult = results[1];
+    if (recvResult.res == 0) co_return { true, true, "", std::nullopt };
+
+    buf.resize(recvResult.res);
+    co_return { true, false, buf, std::nullopt };
+}
+
+template <auto Tag>
+Task<> Delegates::Bidirectional<Tag>::recvStream(std::size_t size, RecvHandler handler) {
+    registerOnThisThread(handle);
+
+    // Multishot receives need the provided buffer ring
+    Async::EventLoop& eventLoop = Async::currentEventLoop();
+    if (eventLoop.getProvidedBufferSize() == 0) {
+        co_await recvEach(*this, size, handler);
+        co_return;
+    }
+
+    // An exception from the handler stops the operation, and the remaining completions are drained before rethrowing
+    std::exception_ptr handlerError;
+    bool closed = false;
+
+    auto onRecv = [this, size, &handler, &eventLoop, &handlerError, &closed](const Async::CompletionResult& result) {
+        // The buffer must be recycled even if it won't be passed on
+        std::string data = eventLoop.consumeProvidedBuffer(result);
+        if (handlerError) return;
+
+        try {
+            if (result.res == 0) {
+                closed = true;
+                handler({ true, true, "", std::nullopt });
+                return;
+            }
+
+            // Split the buffer into results of the requested size
+            std::size_t chunkSize = size == 0 ? data.size() : size;
+            for (std::size_t i = 0; i < data.size(); i += chunkSize)
+                handler({ true, false, data.substr(i, chunkSize), std::nullopt });
+        } catch (...) {
+            handlerError = std::current_exception();
+            handle.cancelIO();
+        }
+    };
+
+    try {
+        // The kernel may end a multishot receive without an error (e.g., if the completion queue overflows), rearm it
+        // in that case
+        while (!closed && !handlerError) {
+            bool noBuffers = false;
+
+            try {
+                co_await Async::runMultishot([this](Async::CompletionResult& result) {
+                    Async::submit(Async::ReceiveMultishot{ { *handle, &result } });
+                }, onRecv);
+            } catch (const System::SystemError& e) {
+                // ENOBUFS means all provided buffers are in use, make progress with a single receive before rearming
+                if (e.code != ENOBUFS) throw;
+                noBuffers = true;
+            }
+
+            if (noBuffers) {
+                auto result = co_await recv(size, {});
+                closed = result.closed;
+                handler(std::move(result));
+            }
+        }
+    } catch (const System::SystemError&) {
+        if (!handlerError) throw;
+    }
+
+    if (handlerError) std::rethrow_exception(handlerError);
+}
+
+// Closes a descriptor (if it is valid) when it goes out of scope. The close goes through the event loop like a
+// socket's, so the epoll backend stops watching the descriptor before its number can be reused.
+class FileCloser {
+    int fd;
+
+public:
+    explicit FileCloser(int fd) : fd(fd) {}
+
+    FileCloser(const FileCloser&) = delete;
+
+    ~FileCloser() {
+        if (fd != -1) Async::submit(Async::Close{ { fd, nullptr } });
+    }
+
+    FileCloser& operator=(const FileCloser&) = delete;
+};
+
+template <auto Tag>
+Task<> Delegates::Bidirectional<Tag>::sendFile(std::string path, SendFileHandler handler) {
+    registerOnThisThread(handle);
+
+    // The file is moved into a pipe and from the pipe into the socket, so the data stays in the kernel. A bigger pipe
+    // means fewer operations per file, its default capacity is used if it can't be resized.
+    constexpr int pipeSize = 1024 * 1024;
+    constexpr unsigned int defaultPipeSize = 64 * 1024;
+
+    int file = check(open(path.c_str(), O_RDONLY | O_CLOEXEC));
+    FileCloser fileCloser{ file };
+
+    struct stat fileInfo;
+    check(fstat(file, &fileInfo));
+
+    int pipeFds[2];
+    check(pipe2(pipeFds, O_CLOEXEC));
+    FileCloser readCloser{ pipeFds[0] };
+    FileCloser writeCloser{ pipeFds[1] };
+
+    int capacity = fcntl(pipeFds[1], F_SETPIPE_SZ, pipeSize);
+    auto partSize = capacity > 0 ? static_cast<unsigned int>(capacity) : defaultPipeSize;
+
+    auto fileSize = static_cast<std::int64_t>(fileInfo.st_size);
+    for (std::int64_t offset = 0; offset < fileSize;) {
+        auto size = static_cast<unsigned int>(std::min<std::int64_t>(partSize, fileSize - offset));
+
+        std::optional<Async::CompletionResult> fileResult;
+        try {
+            fileResult = co_await Async::run([&](Async::CompletionResult& result) {
+                Async::submit(Async::Splice{ { pipeFds[1], &result }, file, offset, size });
+            });
+        } catch (const System::SystemError& e) {
+            // Some files (e.g., on certain file systems) can't be spliced, send them from memory instead
+            if (e.code != EINVAL || offset > 0) throw;
+        }
+
+        if (!fileResult) {
+            co_await sendEachPart(*this, path, handler);
+            co_return;
+        }
+
+        // The file got shorter while it was being sent
+        if (fileResult->res == 0) break;
+
+        offset += fileResult->res;
+
+        // Drain the pipe into the socket, which may take more than one operation
+        for (auto remaining = static_cast<unsigned int>(fileResult->res); remaining > 0;) {
+            auto sendResult = co_await Async::run([&](Async::CompletionResult& result) {
+                Async::submit(Async::Splice{ { *handle, &result }, pipeFds[0], -1, remaining });
+            }, System::ErrorType::System, handle.getTimeout());
+
+            remaining -= static_cast<unsigned int>(sendResult.res);
+            handler(static_cast<std::size_t>(sendResult.res));
+        }
+    }
+}
+
+template <auto Tag>
+Task<> Delegates::Bidirectional<Tag>::relay(IODelegate& target, std::size_t sampleSize, RelayHandler handler,
+    std::stop_token stopToken) {
+    registerOnThisThread(handle);
+
+    // Data can only be moved between sockets within the kernel if both are plain sockets
+    auto destination = dynamic_cast<Bidirectional<Tag>*>(&target);
+    if (!destination) {
+        co_await relayEach(*this, target, sampleSize, handler, stopToken);
+        co_return;
+    }
+
+    // Received data is moved into a pipe and from the pipe into the other socket. Samples are copied into a second
+    // pipe with tee, which leaves the data in the first pipe to be forwarded.
+    constexpr int pipeSize = 1024 * 1024;
+    constexpr unsigned int defaultPipeSize = 64 * 1024;
+
+    int pipeFds[2];
+    check(pipe2(pipeFds, O_CLOEXEC));
+    FileCloser readCloser{ pipeFds[0] };
+    FileCloser writeCloser{ pipeFds[1] };
+
+    int capacity = fcntl(pipeFds[1], F_SETPIPE_SZ, pipeSize);
+    auto partSize = capacity > 0 ? static_cast<unsigned int>(capacity) : defaultPipeSize;
+
+    int sampleFds[2] = { -1, -1 };
+    if (sampleSize > 0) check(pipe2(sampleFds, O_CLOEXEC));
+    FileCloser sampleReadCloser{ sampleFds[0] };
+    FileCloser sampleWriteCloser{ sampleFds[1] };
+
+    int source = *handle;
+    int dest = *destination->handle;
+    while (true) {
+        // Connections can be idle for any length of time, so only the sends have a time limit
+        auto recvResult = co_await Async::run([&](Async::CompletionResult& result) {
+            Async::submit(Async::Splice{ { pipeFds[1], &result }, source, -1, partSize });
+        }, System::ErrorType::System, {}, stopToken);
+
+        if (recvResult.res == 0) break;
+
+        // The sample pipe is emptied after each part, so it never holds more than the pipe's default capacity. Reading
+        // it doesn't block since the data is already there.
+        std::string sample;
+        if (sampleSize > 0) {
+            auto size = static_cast<unsigned int>(std::min<std::size_t>({ sampleSize, defaultPipeSize,
+                static_cast<std::size_t>(recvResult.res) }));
+
+            auto teeResult = co_await Async::run([&](Async::CompletionResult& result) {
+                Async::submit(Async::Tee{ { sampleFds[1], &result }, pipeFds[0], size });
+            });
+
+            sample.resize(static_cast<std::size_t>(teeResult.res));
+            ssize_t numRead = read(sampleFds[0], sample.data(), sample.size());
+            sample.resize(numRead > 0 ? static_cast<std::size_t>(numRead) : 0);
+        }
+
+        for (auto remaining = static_cast<unsigned int>(recvResult.res); remaining > 0;) {
+            auto sendResult = co_await Async::run([&](Async::CompletionResult& result) {
+                Async::submit(Async::Splice{ { dest, &result }, pipeFds[0], -1, remaining });
+            }, System::ErrorType::System, destination->handle.getTimeout(), stopToken);
+
+            remaining -= static_cast<unsigned int>(sendResult.res);
+        }
+
+        handler(static_cast<std::size_t>(recvResult.res), std::move(sample));
+    }
+
+    // Pass the end of the data on to the other socket's peer
+    shutdown(dest, SHUT_WR);
+}
+
+template Task<> Delegates::Bidirectional<SocketTag::IP>::send(std::string_view);
+template Task<> Delegates::Bidirectional<SocketTag::IP>::sendSegmented(std::string, std::size_t);
+template Task<RecvResult> Delegates::Bidirectional<SocketTag::IP>::recv(std::size_t, std::stop_token);
+template Task<RecvResult> Delegates::Bidirectional<SocketTag::IP>::sendRecv(std::string_view, std::size_t);
+template Task<> Delegates::Bidirectional<SocketTag::IP>::recvStream(std::size_t, RecvHandler);
+template Task<> Delegates::Bidirectional<SocketTag::IP>::sendFile(std::string, SendFileHandler);
+template Task<> Delegates::Bidirectional<SocketTag::IP>::relay(IODelegate&, std::size_t, RelayHandler, std::stop_token);
 
-template Task<> Delegates::Bidirectional<SocketTag::BT>::send(std::string);
-template Task<RecvResult> Delegates::Bidirectional<SocketTag::BT>::recv(std::size_t);
+template Task<> Delegates::Bidirectional<SocketTag::BT>::send(std::string_view);
+template Task<> Delegates::Bidirectional<SocketTag::BT>::sendSegmented(std::string, std::size_t);
+template Task<RecvResult> Delegates::Bidirectional<SocketTag::BT>::recv(std::size_t, std::stop_token);
+template Task<RecvResult> Delegates::Bidirectional<SocketTag::BT>::sendRecv(std::string_view, std::size_t);
+template Task<> Delegates::Bidirectional<SocketTag::BT>::recvStream(std::size_t, RecvHandler);
+template Task<> Delegates::Bidirectional<SocketTag::BT>::sendFile(std::string, SendFileHandler);
+template Task<> Delegates::Bidirectional<SocketTag::BT>::relay(IODelegate&, std::size_t, RelayHandler, std::stop_token);
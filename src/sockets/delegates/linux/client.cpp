@@ -12,8 +12,10 @@
 #include "net/device.hpp"
 #include "net/enums.hpp"
 #include "net/netutils.hpp"
+#include "net/resolver.hpp"
 #include "os/async.hpp"
 #include "os/errcheck.hpp"
+#include "os/error.hpp"
 
 void startConnect(int s, sockaddr* addr, socklen_t len, Async::CompletionResult& result) {
     Async::submit(Async::Connect{ { s, &result }, addr, len });
@@ -21,11 +23,14 @@ void startConnect(int s, sockaddr* addr, socklen_t len, Async::CompletionResult&
 
 template <>
 Task<> Delegates::Client<SocketTag::IP>::connect(Device device) {
-    auto addr = NetUtils::resolveAddr(device);
+    auto addr = co_await NetUtils::resolveAddrAsync(device);
 
     co_await NetUtils::loopWithAddr(addr.get(), [this](const AddrInfoType* result) -> Task<> {
         handle.reset(check(socket(result->ai_family, result->ai_socktype, result->ai_protocol)));
-        co_await Async::run(std::bind_front(startConnect, *handle, result->ai_addr, result->ai_addrlen));
+        handle.registerFixedFile();
+
+        co_await Async::run(std::bind_front(startConnect, *handle, result->ai_addr, result->ai_addrlen),
+            System::ErrorType::System, handle.getTimeout());
     });
 }
 
@@ -40,11 +45,13 @@ Task<> Delegates::Client<SocketTag::BT>::connect(Device device) {
         sockaddr_rc addr{ AF_BLUETOOTH, bdaddr, static_cast<std::uint8_t>(device.port) };
         handle.reset(check(socket(AF_BLUETOOTH, SOCK_STREAM, BTPROTO_RFCOMM)));
 
-        co_await Async::run(std::bind_front(startConnect, *handle, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)));
+        co_await Async::run(std::bind_front(startConnect, *handle, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)),
+            System::ErrorType::System, handle.getTimeout());
     } else {
         sockaddr_l2 addr{ AF_BLUETOOTH, htobs(device.port), bdaddr, 0, 0 };
         handle.reset(check(socket(AF_BLUETOOTH, SOCK_SEQPACKET, BTPROTO_L2CAP)));
 
-        co_await Async::run(std::bind_front(startConnect, *handle, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)));
+        co_await Async::run(std::bind_front(startConnect, *handle, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)),
+            System::ErrorType::System, handle.getTimeout());
     }
 }
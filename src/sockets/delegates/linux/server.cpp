@@ -3,9 +3,14 @@
 
 #include "sockets/delegates/server.hpp"
 
+#include <algorithm>
+#include <cstddef>
+#include <exception>
 #include <functional>
 #include <memory>
 #include <string>
+#include <string_view>
+#include <utility>
 
 #include <bluetooth/bluetooth.h>
 #include <bluetooth/hci.h>
@@ -16,19 +21,41 @@
 
 #include "net/enums.hpp"
 #include "net/netutils.hpp"
+#include "net/resolver.hpp"
 #include "os/async.hpp"
 #include "os/errcheck.hpp"
+#include "os/error.hpp"
+#include "sockets/delegates/linux/udpoffload.hpp"
 #include "sockets/incomingsocket.hpp"
 #include "utils/strings.hpp"
 #include "utils/task.hpp"
 
+// Largest message a coalesced receive can produce
+constexpr std::size_t maxCoalescedSize = 65535;
+
 void startAccept(int s, sockaddr* clientAddr, socklen_t& clientLen, Async::CompletionResult& result) {
     Async::submit(Async::Accept{ { s, &result }, clientAddr, &clientLen });
 }
 
+// Passes each datagram coalesced into a received message to a function, truncated to the given size.
+void splitDatagrams(const sockaddr* from, socklen_t fromLen, std::string_view payload, std::size_t segmentSize,
+    std::size_t size, const DgramRecvHandler& handler) {
+    Device device = NetUtils::fromAddr(from, fromLen, ConnectionType::UDP);
+
+    UDPOffload::forEachSegment(payload, segmentSize, [&device, size, &handler](std::string_view datagram) {
+        handler({ device, std::string{ datagram.substr(0, size) } });
+    });
+}
+
 template <>
 ServerAddress Delegates::Server<SocketTag::IP>::startServer(const Device& serverInfo) {
-    return NetUtils::startServer(serverInfo, handle);
+    ServerAddress address = NetUtils::startServer(serverInfo, handle);
+
+    // Let the kernel coalesce datagrams of the same size from a client into one message, they are split apart again
+    // when received. This is only an optimization, so it is fine if it's unsupported.
+    if (serverInfo.type == ConnectionType::UDP) traits.coalescing = UDPOffload::setCoalescing(*handle, true);
+
+    return address;
 }
 
 template <>
@@ -37,7 +64,8 @@ Task<AcceptResult> Delegates::Server<SocketTag::IP>::accept() {
     auto clientAddr = reinterpret_cast<sockaddr*>(&client);
     socklen_t clientLen = sizeof(client);
 
-    auto acceptResult = co_await Async::run(std::bind_front(startAccept, *handle, clientAddr, clientLen));
+    auto acceptResult = co_await Async::run(std::bind_front(startAccept, *handle, clientAddr, clientLen),
+        System::ErrorType::System, handle.getTimeout());
 
     Device device = NetUtils::fromAddr(clientAddr, clientLen, ConnectionType::TCP);
     SocketHandle<SocketTag::IP> fd{ acceptResult.res };
@@ -45,16 +73,62 @@ Task<AcceptResult> Delegates::Server<SocketTag::IP>::accept() {
     co_return { device, std::make_unique<IncomingSocket<SocketTag::IP>>(std::move(fd)) };
 }
 
+template <>
+Task<> Delegates::Server<SocketTag::IP>::acceptStream(AcceptHandler handler) {
+    // An exception from the handler stops the operation, and the remaining completions are drained before rethrowing
+    std::exception_ptr handlerError;
+
+    auto onAccept = [this, &handler, &handlerError](const Async::CompletionResult& result) {
+        SocketHandle<SocketTag::IP> fd{ result.res };
+        if (handlerError) return;
+
+        try {
+            // The client address is taken from the socket since multishot accept does not provide one per completion
+            sockaddr_storage client;
+            auto clientAddr = reinterpret_cast<sockaddr*>(&client);
+            socklen_t clientLen = sizeof(client);
+            check(getpeername(*fd, clientAddr, &clientLen));
+
+            Device device = NetUtils::fromAddr(clientAddr, clientLen, ConnectionType::TCP);
+            handler({ device, std::make_unique<IncomingSocket<SocketTag::IP>>(std::move(fd)) });
+        } catch (...) {
+            handlerError = std::current_exception();
+            handle.cancelIO();
+        }
+    };
+
+    try {
+        // The kernel may end a multishot accept without an error (e.g., if the completion queue overflows), rearm it
+        // in that case
+        while (!handlerError) {
+            co_await Async::runMultishot([this](Async::CompletionResult& result) {
+                Async::submit(Async::AcceptMultishot{ { *handle, &result } });
+            }, onAccept);
+        }
+    } catch (const System::SystemError&) {
+        if (!handlerError) throw;
+    }
+
+    std::rethrow_exception(handlerError);
+}
+
 template <>
 Task<DgramRecvResult> Delegates::Server<SocketTag::IP>::recvFrom(std::size_t size) {
+    // Datagrams coalesced into an earlier message are passed on first
+    if (!traits.coalesced.empty()) {
+        DgramRecvResult result = std::move(traits.coalesced.front());
+        traits.coalesced.pop_front();
+        co_return result;
+    }
+
     // io_uring currently does not support recvfrom so recvmsg must be used instead:
     // https://github.com/axboe/liburing/issues/397
     // https://github.com/axboe/liburing/discussions/581
 
+    // With coalescing, the buffer must fit a whole message, or the datagrams after the first one would be cut off
     sockaddr_storage from;
-    auto fromAddr = reinterpret_cast<sockaddr*>(&from);
-    socklen_t len = sizeof(from);
-    std::string data(size, 0);
+    std::string data(traits.coalescing ? std::max(size, maxCoalescedSize) : size, 0);
+    UDPOffload::ControlBuffer<sizeof(int)> control;
 
     iovec iov{
         .iov_base = data.data(),
@@ -63,30 +137,120 @@ Task<DgramRecvResult> Delegates::Server<SocketTag::IP>::recvFrom(std::size_t siz
 
     msghdr msg{
         .msg_name = &from,
-        .msg_namelen = len,
+        .msg_namelen = sizeof(from),
         .msg_iov = &iov,
         .msg_iovlen = 1,
-        .msg_control = nullptr,
-        .msg_controllen = 0,
+        .msg_control = control.data,
+        .msg_controllen = sizeof(control.data),
         .msg_flags = 0,
     };
 
     auto recvResult = co_await Async::run([this, &msg](Async::CompletionResult& result) {
         Async::submit(Async::ReceiveFrom{ { *handle, &result }, &msg });
-    });
+    }, System::ErrorType::System, handle.getTimeout());
 
-    data.resize(recvResult.res);
-    co_return { NetUtils::fromAddr(fromAddr, len, ConnectionType::UDP), data };
+    std::size_t segmentSize = 0;
+    for (cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
+        segmentSize = std::max(segmentSize, UDPOffload::getSegmentSize(cmsg));
+
+    std::string_view payload{ data.data(), static_cast<std::size_t>(recvResult.res) };
+    splitDatagrams(reinterpret_cast<sockaddr*>(&from), msg.msg_namelen, payload, segmentSize, size,
+        [this](DgramRecvResult result) { traits.coalesced.push_back(std::move(result)); });
+
+    DgramRecvResult result = std::move(traits.coalesced.front());
+    traits.coalesced.pop_front();
+    co_return result;
+}
+
+template <>
+Task<> Delegates::Server<SocketTag::IP>::recvFromStream(std::size_t size, DgramRecvHandler handler) {
+    // Multishot receives need the provided buffer ring
+    Async::EventLoop& eventLoop = Async::currentEventLoop();
+    if (eventLoop.getProvidedBufferSize() == 0) {
+        while (true) handler(co_await recvFrom(size));
+    }
+
+    // Datagrams coalesced into a message by an earlier receive are passed on first
+    for (; !traits.coalesced.empty(); traits.coalesced.pop_front()) handler(std::move(traits.coalesced.front()));
+
+    // The message header only describes the layout of each buffer: space for the source address, the segment size of
+    // coalesced datagrams, and the rest for the payload
+    msghdr msg{};
+    msg.msg_namelen = sizeof(sockaddr_storage);
+    msg.msg_controllen = UDPOffload::controlSize;
+
+    // An exception from the handler stops the operation, and the remaining completions are drained before rethrowing
+    std::exception_ptr handlerError;
+
+    auto onRecv = [this, size, &handler, &eventLoop, &msg, &handlerError](const Async::CompletionResult& result) {
+        // The buffer must be recycled even if it won't be passed on
+        std::string buf = eventLoop.consumeProvidedBuffer(result);
+        if (handlerError) return;
+
+        auto out = io_uring_recvmsg_validate(buf.data(), static_cast<int>(buf.size()), &msg);
+        if (!out) return;
+
+        try {
+            auto fromAddr = static_cast<sockaddr*>(io_uring_recvmsg_name(out));
+            auto fromLen = std::min<socklen_t>(out->namelen, msg.msg_namelen);
+            auto payload = static_cast<const char*>(io_uring_recvmsg_payload(out, &msg));
+            auto payloadLen = io_uring_recvmsg_payload_length(out, static_cast<int>(buf.size()), &msg);
+
+            std::size_t segmentSize = 0;
+            for (auto cmsg = io_uring_recvmsg_cmsg_firsthdr(out, &msg); cmsg;
+                 cmsg = io_uring_recvmsg_cmsg_nexthdr(out, &msg, cmsg))
+                segmentSize = std::max(segmentSize, UDPOffload::getSegmentSize(cmsg));
+
+            // Datagrams longer than the requested size are truncated, as they are with a single receive
+            splitDatagrams(fromAddr, fromLen, { payload, payloadLen }, segmentSize, size, handler);
+        } catch (...) {
+            handlerError = std::current_exception();
+            handle.cancelIO();
+        }
+    };
+
+    try {
+        // The kernel may end a multishot receive without an error (e.g., if the completion queue overflows), rearm it
+        // in that case
+        while (!handlerError) {
+            bool noBuffers = false;
+
+            try {
+                co_await Async::runMultishot([this, &msg](Async::CompletionResult& result) {
+                    Async::submit(Async::ReceiveFromMultishot{ { *handle, &result }, &msg });
+                }, onRecv);
+            } catch (const System::SystemError& e) {
+                // ENOBUFS means all provided buffers are in use, make progress with a single receive before rearming
+                if (e.code != ENOBUFS) throw;
+                noBuffers = true;
+            }
+
+            if (noBuffers) handler(co_await recvFrom(size));
+        }
+    } catch (const System::SystemError&) {
+        if (!handlerError) throw;
+    }
+
+    std::rethrow_exception(handlerError);
 }
 
 template <>
 Task<> Delegates::Server<SocketTag::IP>::sendTo(Device device, std::string data) {
-    auto addr = NetUtils::resolveAddr(device, false);
+    auto addr = co_await NetUtils::resolveAddrAsync(device, false);
 
     co_await NetUtils::loopWithAddr(addr.get(), [this, &data](const AddrInfoType* resolveRes) -> Task<> {
         co_await Async::run([this, &data, &resolveRes](Async::CompletionResult& result) {
             Async::submit(Async::SendTo{ { *handle, &result }, data, resolveRes->ai_addr, resolveRes->ai_addrlen });
-        });
+        }, System::ErrorType::System, handle.getTimeout());
+    });
+}
+
+template <>
+Task<> Delegates::Server<SocketTag::IP>::sendToSegmented(Device device, std::string data, std::size_t segmentSize) {
+    auto addr = co_await NetUtils::resolveAddrAsync(device, false);
+
+    co_await NetUtils::loopWithAddr(addr.get(), [this, &data, segmentSize](const AddrInfoType* resolveRes) -> Task<> {
+        co_await UDPOffload::send(handle, data, segmentSize, resolveRes->ai_addr, resolveRes->ai_addrlen);
     });
 }
 
@@ -136,7 +300,8 @@ Task<AcceptResult> Delegates::Server<SocketTag::BT>::accept() {
         auto clientAddr = reinterpret_cast<sockaddr*>(&client);
         socklen_t clientLen = sizeof(client);
 
-        auto acceptResult = co_await Async::run(std::bind_front(startAccept, *handle, clientAddr, clientLen));
+        auto acceptResult = co_await Async::run(std::bind_front(startAccept, *handle, clientAddr, clientLen),
+            System::ErrorType::System, handle.getTimeout());
 
         device = { ConnectionType::RFCOMM, "", "", client.rc_channel };
         clientbdAddr = client.rc_bdaddr;
@@ -147,7 +312,8 @@ Task<AcceptResult> Delegates::Server<SocketTag::BT>::accept() {
         auto clientAddr = reinterpret_cast<sockaddr*>(&client);
         socklen_t clientLen = sizeof(client);
 
-        auto acceptResult = co_await Async::run(std::bind_front(startAccept, *handle, clientAddr, clientLen));
+        auto acceptResult = co_await Async::run(std::bind_front(startAccept, *handle, clientAddr, clientLen),
+            System::ErrorType::System, handle.getTimeout());
 
         device = { ConnectionType::L2CAP, "", "", btohs(client.l2_psm) };
         clientbdAddr = client.l2_bdaddr;
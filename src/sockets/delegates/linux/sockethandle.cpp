@@ -3,13 +3,28 @@
 
 #include "sockets/delegates/sockethandle.hpp"
 
+#include <memory>
+#include <thread>
+#include <utility>
+#include <vector>
+
 #include "net/enums.hpp"
 #include "os/async.hpp"
 
 template <auto Tag>
 void Delegates::SocketHandle<Tag>::closeImpl() {
-    Async::submit(Async::Shutdown{ { **this, nullptr } });
-    Async::submit(Async::Close{ { **this, nullptr } });
+    // Fixed files must be closed through the event loop that registered them so they are unregistered before their
+    // descriptor numbers can be reused
+    std::thread::id thread = isFixedFile() ? std::exchange(fixedFileThread, {}) : std::this_thread::get_id();
+
+    // The close is hard-linked so it only starts after the shutdown, and still runs if the shutdown fails (e.g., on
+    // sockets that aren't connected)
+    auto ops = std::make_shared<const std::vector<Async::Operation>>(std::vector<Async::Operation>{
+        Async::Shutdown{ { **this, nullptr } },
+        Async::Close{ { **this, nullptr } },
+    });
+
+    Async::submit(thread, Async::Linked{ { **this, nullptr }, std::move(ops), true });
 }
 
 template <auto Tag>
@@ -17,8 +32,14 @@ void Delegates::SocketHandle<Tag>::cancelIO() {
     Async::submit(Async::Cancel{ { **this, nullptr } });
 }
 
+template <auto Tag>
+void Delegates::SocketHandle<Tag>::registerFixedFile() {
+    if (!isFixedFile() && Async::currentEventLoop().registerFile(**this)) fixedFileThread = std::this_thread::get_id();
+}
+
 template void Delegates::SocketHandle<SocketTag::IP>::closeImpl();
 template void Delegates::SocketHandle<SocketTag::IP>::cancelIO();
+template void Delegates::SocketHandle<SocketTag::IP>::registerFixedFile();
 
 template void Delegates::SocketHandle<SocketTag::BT>::closeImpl();
 template void Delegates::SocketHandle<SocketTag::BT>::cancelIO();
@@ -0,0 +1,112 @@
+// Copyright 2021-2024 Aidan Sun and the WhaleConnect contributors
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "udpoffload.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+#include <netinet/udp.h>
+#include <sys/socket.h>
+
+#include "os/async.hpp"
+#include "os/error.hpp"
+#include "utils/task.hpp"
+
+// Most datagrams the kernel accepts in one segmented send
+constexpr std::size_t maxSegments = 64;
+
+// Largest payload of a UDP datagram, which also limits the total size of a segmented send
+constexpr std::size_t maxPayload = 65507;
+
+// Sends one datagram.
+Task<> sendOne(const Delegates::SocketHandle<SocketTag::IP>& handle, std::string_view data, sockaddr* addr,
+    socklen_t addrLen) {
+    co_await Async::run([&handle, data, addr, addrLen](Async::CompletionResult& result) {
+        if (addr) Async::submit(Async::SendTo{ { *handle, &result }, data, addr, addrLen });
+        else Async::submit(Async::Send{ { *handle, &result }, data });
+    }, System::ErrorType::System, handle.getTimeout());
+}
+
+// Sends datagrams of the given size with one operation, the kernel splits the data into them.
+Task<> sendSegments(const Delegates::SocketHandle<SocketTag::IP>& handle, std::string_view data,
+    std::size_t segmentSize, sockaddr* addr, socklen_t addrLen) {
+    UDPOffload::ControlBuffer<sizeof(std::uint16_t)> control{};
+
+    iovec iov{
+        .iov_base = const_cast<char*>(data.data()),
+        .iov_len = data.size(),
+    };
+
+    msghdr msg{
+        .msg_name = addr,
+        .msg_namelen = addr ? addrLen : 0,
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = control.data,
+        .msg_controllen = sizeof(control.data),
+        .msg_flags = 0,
+    };
+
+    cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_UDP;
+    cmsg->cmsg_type = UDP_SEGMENT;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(std::uint16_t));
+
+    auto size = static_cast<std::uint16_t>(segmentSize);
+    std::memcpy(CMSG_DATA(cmsg), &size, sizeof(size));
+
+    co_await Async::run([&handle, &msg](Async::CompletionResult& result) {
+        Async::submit(Async::SendMessage{ { *handle, &result }, &msg });
+    }, System::ErrorType::System, handle.getTimeout());
+}
+
+Task<> UDPOffload::send(const Delegates::SocketHandle<SocketTag::IP>& handle, std::string_view data,
+    std::size_t segmentSize, sockaddr* addr, socklen_t addrLen) {
+    if (segmentSize == 0 || segmentSize >= data.size()) {
+        co_await sendOne(handle, data, addr, addrLen);
+        co_return;
+    }
+
+    // Datagrams too large to fit more than one in a send are sent one at a time
+    std::size_t batchSize = std::min(maxSegments, maxPayload / segmentSize) * segmentSize;
+    bool offload = batchSize > segmentSize;
+
+    while (!data.empty()) {
+        if (offload) {
+            std::string_view batch = data.substr(0, batchSize);
+
+            try {
+                co_await sendSegments(handle, batch, segmentSize, addr, addrLen);
+                data.remove_prefix(batch.size());
+                continue;
+            } catch (const System::SystemError& e) {
+                // Kernels without segmentation offload reject the control message (EINVAL), and so do routes that
+                // can't carry segments of this size. Devices without checksum offload reject the send (EIO).
+                if (e.code != EINVAL && e.code != EIO) throw;
+                offload = false;
+            }
+        }
+
+        std::string_view segment = data.substr(0, segmentSize);
+        co_await sendOne(handle, segment, addr, addrLen);
+        data.remove_prefix(segment.size());
+    }
+}
+
+bool UDPOffload::setCoalescing(int fd, bool enabled) {
+    int value = enabled ? 1 : 0;
+    return setsockopt(fd, SOL_UDP, UDP_GRO, &value, sizeof(value)) == 0;
+}
+
+std::size_t UDPOffload::getSegmentSize(const cmsghdr* cmsg) {
+    if (cmsg->cmsg_level != SOL_UDP || cmsg->cmsg_type != UDP_GRO) return 0;
+
+    int size = 0;
+    std::memcpy(&size, CMSG_DATA(cmsg), sizeof(size));
+    return size > 0 ? static_cast<std::size_t>(size) : 0;
+}
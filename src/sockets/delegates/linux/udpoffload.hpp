@@ -0,0 +1,54 @@
+// Copyright 2021-2024 Aidan Sun and the WhaleConnect contributors
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <string_view>
+
+#include <sys/socket.h>
+
+#include "net/enums.hpp"
+#include "sockets/delegates/sockethandle.hpp"
+#include "utils/task.hpp"
+
+// UDP segmentation offload: many datagrams of the same size are moved with one operation, and the kernel splits them
+// (GSO) or joins them (GRO) at the edge of the network stack.
+namespace UDPOffload {
+    // Space needed for the control data of a coalesced receive
+    constexpr std::size_t controlSize = CMSG_SPACE(sizeof(int));
+
+    // Buffer for a control message holding a value of the given size. The union keeps it aligned for the message
+    // header (whose first member is a size_t), including in coroutine frames, which may ignore alignas on arrays.
+    template <std::size_t Size>
+    union ControlBuffer {
+        std::size_t alignment;
+        char data[CMSG_SPACE(Size)];
+    };
+
+    // Sends data as datagrams of the given size (the last one may be shorter) to an address, or to the connected peer
+    // if the address is null. Each send gives the kernel as many datagrams as it accepts at once. If segmentation is
+    // unsupported, the datagrams are sent one at a time instead.
+    Task<> send(const Delegates::SocketHandle<SocketTag::IP>& handle, std::string_view data, std::size_t segmentSize,
+        sockaddr* addr, socklen_t addrLen);
+
+    // Enables or disables coalescing received datagrams on a socket. Returns false if this is unsupported.
+    bool setCoalescing(int fd, bool enabled);
+
+    // Gets the size of the datagrams coalesced into a received message from one of its control messages, or 0 if the
+    // control message doesn't hold one.
+    std::size_t getSegmentSize(const cmsghdr* cmsg);
+
+    // Calls a function with each datagram coalesced into a received payload. A segment size of 0 means the payload is
+    // one datagram.
+    template <class Fn>
+    void forEachSegment(std::string_view payload, std::size_t segmentSize, Fn fn) {
+        if (segmentSize == 0) segmentSize = std::max<std::size_t>(payload.size(), 1);
+
+        // An empty datagram is still a datagram
+        if (payload.empty()) fn(payload);
+
+        for (std::size_t i = 0; i < payload.size(); i += segmentSize) fn(payload.substr(i, segmentSize));
+    }
+}
@@ -5,7 +5,9 @@
 
 #include <functional>
 #include <optional>
+#include <stop_token>
 #include <string>
+#include <string_view>
 
 #include <BluetoothMacOS-Swift.h>
 #include <sys/socket.h>
@@ -18,7 +20,7 @@
 #include "utils/task.hpp"
 
 template <>
-Task<> Delegates::Bidirectional<SocketTag::IP>::send(std::string data) {
+Task<> Delegates::Bidirectional<SocketTag::IP>::send(std::string_view data) {
     co_await Async::run([this](Async::CompletionResult& result) {
         Async::submit(Async::Send{ { *handle, &result } });
     });
@@ -27,10 +29,10 @@ Task<> Delegates::Bidirectional<SocketTag::IP>::send(std::string data) {
 }
 
 template <>
-Task<RecvResult> Delegates::Bidirectional<SocketTag::IP>::recv(std::size_t size) {
+Task<RecvResult> Delegates::Bidirectional<SocketTag::IP>::recv(std::size_t size, std::stop_token stopToken) {
     co_await Async::run([this](Async::CompletionResult& result) {
         Async::submit(Async::Receive{ { *handle, &result } });
-    });
+    }, System::ErrorType::System, {}, stopToken);
 
     std::string data(size, 0);
     auto recvLen = check(::recv(*handle, data.data(), data.size(), 0));
@@ -42,14 +44,14 @@ Task<RecvResult> Delegates::Bidirectional<SocketTag::IP>::recv(std::size_t size)
 }
 
 template <>
-Task<> Delegates::Bidirectional<SocketTag::BT>::send(std::string data) {
-    check((*handle)->write(data), checkZero, useReturnCode, System::ErrorType::IOReturn);
+Task<> Delegates::Bidirectional<SocketTag::BT>::send(std::string_view data) {
+    check((*handle)->write(std::string{ data }), checkZero, useReturnCode, System::ErrorType::IOReturn);
     co_await Async::run(std::bind_front(AsyncBT::submit, (*handle)->getHash(), IOType::Send),
         System::ErrorType::IOReturn);
 }
 
 template <>
-Task<RecvResult> Delegates::Bidirectional<SocketTag::BT>::recv(std::size_t) {
+Task<RecvResult> Delegates::Bidirectional<SocketTag::BT>::recv(std::size_t, std::stop_token) {
     co_await Async::run(std::bind_front(AsyncBT::submit, (*handle)->getHash(), IOType::Receive),
         System::ErrorType::IOReturn);
 
@@ -12,6 +12,7 @@
 #include "net/device.hpp"
 #include "net/enums.hpp"
 #include "net/netutils.hpp"
+#include "net/resolver.hpp"
 #include "os/async.hpp"
 #include "os/bluetooth.hpp"
 #include "os/errcheck.hpp"
@@ -19,7 +20,7 @@
 
 template <>
 Task<> Delegates::Client<SocketTag::IP>::connect(Device device) {
-    auto addr = NetUtils::resolveAddr(device);
+    auto addr = co_await NetUtils::resolveAddrAsync(device);
 
     co_await NetUtils::loopWithAddr(addr.get(), [this](const AddrInfoType* result) -> Task<> {
         handle.reset(check(::socket(result->ai_family, result->ai_socktype, result->ai_protocol)));
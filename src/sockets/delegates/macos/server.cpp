@@ -10,6 +10,7 @@
 #include <sys/socket.h>
 
 #include "net/netutils.hpp"
+#include "net/resolver.hpp"
 #include "os/async.hpp"
 #include "os/bluetooth.hpp"
 #include "os/errcheck.hpp"
@@ -61,7 +62,7 @@ Task<DgramRecvResult> Delegates::Server<SocketTag::IP>::recvFrom(std::size_t siz
 
 template <>
 Task<> Delegates::Server<SocketTag::IP>::sendTo(Device device, std::string data) {
-    auto addr = NetUtils::resolveAddr(device, false);
+    auto addr = co_await NetUtils::resolveAddrAsync(device, false);
 
     co_await NetUtils::loopWithAddr(addr.get(), [this, &data](const AddrInfoType* resolveRes) -> Task<> {
         co_await Async::run([this](Async::CompletionResult& result) {
@@ -3,7 +3,9 @@
 
 #pragma once
 
+#include <stop_token>
 #include <string>
+#include <string_view>
 
 #include "delegates.hpp"
 #include "net/device.hpp"
@@ -13,13 +15,33 @@
 namespace Delegates {
     // Provides no-ops for I/O operations.
     struct NoopIO : IODelegate {
-        Task<> send(std::string) override {
+        Task<> send(std::string_view) override {
             co_return;
         }
 
-        Task<RecvResult> recv(std::size_t) override {
+        Task<> sendSegmented(std::string, std::size_t) override {
+            co_return;
+        }
+
+        Task<RecvResult> recv(std::size_t, std::stop_token) override {
+            co_return {};
+        }
+
+        Task<RecvResult> sendRecv(std::string_view, std::size_t) override {
             co_return {};
         }
+
+        Task<> recvStream(std::size_t, RecvHandler) override {
+            co_return;
+        }
+
+        Task<> sendFile(std::string, SendFileHandler) override {
+            co_return;
+        }
+
+        Task<> relay(IODelegate&, std::size_t, RelayHandler, std::stop_token) override {
+            co_return;
+        }
     };
 
     // Provides no-ops for client operations.
@@ -39,12 +61,24 @@ namespace Delegates {
             co_return {};
         }
 
+        Task<> acceptStream(AcceptHandler) override {
+            co_return;
+        }
+
         Task<DgramRecvResult> recvFrom(std::size_t) override {
             co_return {};
         }
 
+        Task<> recvFromStream(std::size_t, DgramRecvHandler) override {
+            co_return;
+        }
+
         Task<> sendTo(Device, std::string) override {
             co_return;
         }
+
+        Task<> sendToSegmented(Device, std::string, std::size_t) override {
+            co_return;
+        }
     };
 }
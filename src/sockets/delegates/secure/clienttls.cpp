@@ -7,6 +7,7 @@
 #include <optional>
 #include <span>
 #include <string>
+#include <string_view>
 #include <vector>
 
 #include <botan/certstor_system.h>
@@ -62,13 +63,25 @@ Task<> Delegates::ClientTLS::sendQueued() {
     }
 }
 
-Task<bool> Delegates::ClientTLS::recvBase(std::size_t size) {
-    auto recvResult = co_await baseIO.recv(size);
-
+bool Delegates::ClientTLS::passReceived(RecvResult& recvResult) {
     if (recvResult.closed) channel->close();
     else channel->received_data(reinterpret_cast<std::uint8_t*>(recvResult.data.data()), recvResult.data.size());
 
-    co_return recvResult.closed;
+    return recvResult.closed;
+}
+
+Task<bool> Delegates::ClientTLS::recvBase(std::size_t size, std::stop_token stopToken) {
+    auto recvResult = co_await baseIO.recv(size, std::move(stopToken));
+    co_return passReceived(recvResult);
+}
+
+Task<bool> Delegates::ClientTLS::sendRecvBase(std::size_t size) {
+    // The queued data is joined so it can be sent with one operation linked to the receive
+    std::string data;
+    for (; !pendingWrites.empty(); pendingWrites.pop()) data += pendingWrites.front();
+
+    auto recvResult = co_await baseIO.sendRecv(data, size);
+    co_return passReceived(recvResult);
 }
 
 void Delegates::ClientTLS::close() {
@@ -88,23 +101,22 @@ Task<> Delegates::ClientTLS::connect(Device device) {
     // Perform TLS handshake until channel is active
     do {
         // Client initiates handshake to server; send before receiving
-        co_await sendQueued();
-        bool closed = co_await recvBase(1024);
+        bool closed = co_await sendRecvBase(1024);
         if (closed) break;
     } while (!channel->is_active() && !channel->is_closed());
 }
 
-Task<> Delegates::ClientTLS::send(std::string data) {
+Task<> Delegates::ClientTLS::send(std::string_view data) {
     if (channel) {
         channel->send(data);
         co_await sendQueued();
     }
 }
 
-Task<RecvResult> Delegates::ClientTLS::recv(std::size_t size) {
+Task<RecvResult> Delegates::ClientTLS::recv(std::size_t size, std::stop_token stopToken) {
     // A record may take multiple receive calls to come in
     if (completedReads.empty()) {
-        if (co_await recvBase(size)) co_return { true, true, "", std::nullopt };
+        if (co_await recvBase(size, std::move(stopToken))) co_return { true, true, "", std::nullopt };
 
         co_return { false, false, "", std::nullopt };
     }
@@ -3,9 +3,13 @@
 
 #pragma once
 
+#include <chrono>
 #include <optional>
 #include <queue>
+#include <stop_token>
 #include <string>
+#include <string_view>
+#include <utility>
 
 #include <botan/tls_alert.h>
 #include <botan/tls_client.h>
@@ -32,13 +36,20 @@ namespace Delegates {
         // Sends all encrypted TLS data over the socket.
         Task<> sendQueued();
 
+        // Passes raw TLS data received over the socket to the internal channel. Returns true if the connection was
+        // closed.
+        bool passReceived(RecvResult& recvResult);
+
+        // Sends all encrypted TLS data over the socket along with a receive of raw TLS data (see recvBase).
+        Task<bool> sendRecvBase(std::size_t size);
+
     public:
         ~ClientTLS() {
             close();
         }
 
         // Receives raw TLS data and passes it to the internal channel.
-        Task<bool> recvBase(std::size_t size);
+        Task<bool> recvBase(std::size_t size, std::stop_token stopToken = {});
 
         void queueRead(std::string data) {
             completedReads.push({ true, false, data, std::nullopt });
@@ -65,10 +76,41 @@ namespace Delegates {
             handle.cancelIO();
         }
 
+        void setTimeout(std::chrono::milliseconds timeout) override {
+            handle.setTimeout(timeout);
+        }
+
         Task<> connect(Device device) override;
 
-        Task<> send(std::string data) override;
+        Task<> send(std::string_view data) override;
+
+        Task<RecvResult> recv(std::size_t size, std::stop_token stopToken) override;
+
+        // Data must be encrypted before it is sent, and a record may take more than one receive to come in, so
+        // requests and responses are sent and received separately.
+        Task<RecvResult> sendRecv(std::string_view data, std::size_t size) override {
+            co_return co_await sendThenRecv(*this, data, size);
+        }
+
+        // TLS runs over a stream, so there are no message boundaries to keep.
+        Task<> sendSegmented(std::string data, std::size_t) override {
+            co_await send(data);
+        }
+
+        // Each TLS record must be decrypted before it can be passed on, so data is received one operation at a time.
+        Task<> recvStream(std::size_t size, RecvHandler handler) override {
+            co_await recvEach(*this, size, handler);
+        }
 
-        Task<RecvResult> recv(std::size_t size) override;
+        // Data must be encrypted before it is sent, so files are read into memory one part at a time.
+        Task<> sendFile(std::string path, SendFileHandler handler) override {
+            co_await sendEachPart(*this, path, handler);
+        }
+
+        // Relayed data is decrypted, so it is received into memory one part at a time.
+        Task<> relay(IODelegate& target, std::size_t sampleSize, RelayHandler handler,
+            std::stop_token stopToken) override {
+            co_await relayEach(*this, target, sampleSize, handler, stopToken);
+        }
     };
 }
@@ -12,6 +12,7 @@
 #include "traits.hpp"
 #include "net/device.hpp"
 #include "net/enums.hpp"
+#include "sockets/socket.hpp" // IWYU pragma: keep
 #include "utils/task.hpp"
 
 namespace Delegates {
@@ -28,12 +29,49 @@ namespace Delegates {
 
         Task<AcceptResult> accept() override;
 
+        Task<> acceptStream(AcceptHandler handler) override;
+
         Task<DgramRecvResult> recvFrom(std::size_t size) override;
 
+        Task<> recvFromStream(std::size_t size, DgramRecvHandler handler) override;
+
         Task<> sendTo(Device device, std::string data) override;
+
+        Task<> sendToSegmented(Device device, std::string data, std::size_t segmentSize) override;
     };
 }
 
+// Without a platform-specific implementation, clients are accepted one at a time
+template <auto Tag>
+Task<> Delegates::Server<Tag>::acceptStream(AcceptHandler handler) {
+    while (true) handler(co_await accept());
+}
+
+// Datagrams are also received one at a time
+template <auto Tag>
+Task<> Delegates::Server<Tag>::recvFromStream(std::size_t size, DgramRecvHandler handler) {
+    while (true) handler(co_await recvFrom(size));
+}
+
+// Each datagram is sent with its own operation
+template <auto Tag>
+Task<> Delegates::Server<Tag>::sendToSegmented(Device device, std::string data, std::size_t segmentSize) {
+    if (segmentSize == 0) segmentSize = data.size();
+
+    for (std::size_t i = 0; i < data.size(); i += segmentSize) co_await sendTo(device, data.substr(i, segmentSize));
+}
+
+#if OS_LINUX
+template <>
+Task<> Delegates::Server<SocketTag::IP>::acceptStream(AcceptHandler handler);
+
+template <>
+Task<> Delegates::Server<SocketTag::IP>::recvFromStream(std::size_t size, DgramRecvHandler handler);
+
+template <>
+Task<> Delegates::Server<SocketTag::IP>::sendToSegmented(Device device, std::string data, std::size_t segmentSize);
+#endif
+
 template <>
 ServerAddress Delegates::Server<SocketTag::BT>::startServer(const Device& serverInfo);
 
@@ -47,7 +85,17 @@ inline Task<DgramRecvResult> Delegates::Server<SocketTag::BT>::recvFrom(std::siz
     std::unreachable();
 }
 
+template <>
+inline Task<> Delegates::Server<SocketTag::BT>::recvFromStream(std::size_t, DgramRecvHandler) {
+    std::unreachable();
+}
+
 template <>
 inline Task<> Delegates::Server<SocketTag::BT>::sendTo(Device, std::string) {
     std::unreachable();
 }
+
+template <>
+inline Task<> Delegates::Server<SocketTag::BT>::sendToSegmented(Device, std::string, std::size_t) {
+    std::unreachable();
+}
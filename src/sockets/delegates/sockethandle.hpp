@@ -3,8 +3,13 @@
 
 #pragma once
 
+#include <chrono>
 #include <utility>
 
+#if OS_LINUX
+#include <thread>
+#endif
+
 #include "delegates.hpp"
 #include "traits.hpp"
 
@@ -17,6 +22,12 @@ namespace Delegates {
 
         Handle handle;
         bool closed = false;
+        std::chrono::milliseconds timeout{};
+
+#if OS_LINUX
+        // Thread whose event loop has the handle in its fixed file table (empty if not registered)
+        std::thread::id fixedFileThread;
+#endif
 
         void closeImpl();
 
@@ -33,13 +44,20 @@ namespace Delegates {
         SocketHandle(const SocketHandle&) = delete;
 
         // Constructs an object and transfers ownership from another object.
-        SocketHandle(SocketHandle&& other) noexcept : handle(other.release()) {}
+        SocketHandle(SocketHandle&& other) noexcept : handle(other.release()) {
+#if OS_LINUX
+            fixedFileThread = std::exchange(other.fixedFileThread, {});
+#endif
+        }
 
         SocketHandle& operator=(const SocketHandle&) = delete;
 
         // Transfers ownership from another object.
         SocketHandle& operator=(SocketHandle&& other) noexcept {
             reset(other.release());
+#if OS_LINUX
+            fixedFileThread = std::exchange(other.fixedFileThread, {});
+#endif
             return *this;
         }
 
@@ -56,6 +74,27 @@ namespace Delegates {
 
         void cancelIO() override;
 
+        void setTimeout(std::chrono::milliseconds newTimeout) override {
+            timeout = newTimeout;
+        }
+
+        // Gets the time limit of each operation.
+        std::chrono::milliseconds getTimeout() const {
+            return timeout;
+        }
+
+#if OS_LINUX
+        // Registers the socket in the fixed file table of the current thread's event loop if it isn't registered yet.
+        // Its operations submitted on that thread refer to it without file lookups, and it is closed through that event
+        // loop.
+        void registerFixedFile();
+
+        // Checks if the socket is registered in a fixed file table.
+        bool isFixedFile() const {
+            return fixedFileThread != std::thread::id{};
+        }
+#endif
+
         // Closes the current handle and acquires a new one.
         void reset(Handle other = invalidHandle) noexcept {
             close();
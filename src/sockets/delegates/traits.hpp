@@ -9,6 +9,10 @@
 #include <optional>
 
 #include <BluetoothMacOS-Swift.h>
+#elif OS_LINUX
+#include <deque>
+
+#include "delegates.hpp"
 #endif
 
 #include "net/enums.hpp"
@@ -61,5 +65,9 @@ namespace Traits {
     template <>
     struct Server<SocketTag::IP> {
         IPType ip;
+#if OS_LINUX
+        std::deque<DgramRecvResult> coalesced; // Datagrams received along with an earlier one, not passed on yet
+        bool coalescing = false; // If the kernel may coalesce received datagrams into one message
+#endif
     };
 }
@@ -3,26 +3,29 @@
 
 #include "sockets/delegates/bidirectional.hpp"
 
+#include <stop_token>
 #include <string>
+#include <string_view>
 
 #include "net/enums.hpp"
 #include "os/async.hpp"
+#include "os/error.hpp"
 #include "utils/task.hpp"
 
 template <auto Tag>
-Task<> Delegates::Bidirectional<Tag>::send(std::string data) {
+Task<> Delegates::Bidirectional<Tag>::send(std::string_view data) {
     co_await Async::run([this, &data](Async::CompletionResult& result) {
         Async::submit(Async::Send{ { *handle, &result }, data });
     });
 }
 
 template <auto Tag>
-Task<RecvResult> Delegates::Bidirectional<Tag>::recv(std::size_t size) {
+Task<RecvResult> Delegates::Bidirectional<Tag>::recv(std::size_t size, std::stop_token stopToken) {
     std::string data(size, 0);
 
     auto recvResult = co_await Async::run([this, &data](Async::CompletionResult& result) {
         Async::submit(Async::Receive{ { *handle, &result }, data });
-    });
+    }, System::ErrorType::System, {}, stopToken);
 
     // Check for disconnects
     if (recvResult.res == 0) co_return { true, true, "", std::nullopt };
@@ -32,8 +35,8 @@ Task<RecvResult> Delegates::Bidirectional<Tag>::recv(std::size_t size) {
     co_return { true, false, data, std::nullopt };
 }
 
-template Task<> Delegates::Bidirectional<SocketTag::IP>::send(std::string);
-template Task<RecvResult> Delegates::Bidirectional<SocketTag::IP>::recv(std::size_t);
+template Task<> Delegates::Bidirectional<SocketTag::IP>::send(std::string_view);
+template Task<RecvResult> Delegates::Bidirectional<SocketTag::IP>::recv(std::size_t, std::stop_token);
 
-template Task<> Delegates::Bidirectional<SocketTag::BT>::send(std::string);
-template Task<RecvResult> Delegates::Bidirectional<SocketTag::BT>::recv(std::size_t);
+template Task<> Delegates::Bidirectional<SocketTag::BT>::send(std::string_view);
+template Task<RecvResult> Delegates::Bidirectional<SocketTag::BT>::recv(std::size_t, std::stop_token);
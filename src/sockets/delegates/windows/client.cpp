@@ -13,6 +13,7 @@
 
 #include "net/enums.hpp"
 #include "net/netutils.hpp"
+#include "net/resolver.hpp"
 #include "os/async.hpp"
 #include "os/errcheck.hpp"
 #include "utils/strings.hpp"
@@ -40,7 +41,7 @@ void finalizeConnect(SOCKET s) {
 
 template <>
 Task<> Delegates::Client<SocketTag::IP>::connect(Device device) {
-    auto addr = NetUtils::resolveAddr(device);
+    auto addr = co_await NetUtils::resolveAddrAsync(device);
 
     co_await NetUtils::loopWithAddr(addr.get(), [this, type = device.type](const AddrInfoType* result) -> Task<> {
         handle.reset(check(socket(result->ai_family, result->ai_socktype, result->ai_protocol)));
@@ -16,6 +16,7 @@
 #include <ztd/out_ptr.hpp>
 
 #include "net/netutils.hpp"
+#include "net/resolver.hpp"
 #include "os/async.hpp"
 #include "os/errcheck.hpp"
 #include "sockets/incomingsocket.hpp"
@@ -98,7 +99,7 @@ Task<DgramRecvResult> Delegates::Server<SocketTag::IP>::recvFrom(std::size_t siz
 
 template <>
 Task<> Delegates::Server<SocketTag::IP>::sendTo(Device device, std::string data) {
-    auto addr = NetUtils::resolveAddr(device, false);
+    auto addr = co_await NetUtils::resolveAddrAsync(device, false);
 
     co_await NetUtils::loopWithAddr(addr.get(), [this, &data](const AddrInfoType* resolveRes) -> Task<> {
         co_await Async::run([this, resolveRes, &data](Async::CompletionResult& result) {
@@ -3,7 +3,12 @@
 
 #pragma once
 
+#include <chrono>
+#include <concepts>
+#include <stop_token>
 #include <string>
+#include <string_view>
+#include <utility>
 
 #include "delegates/delegates.hpp"
 #include "net/device.hpp"
@@ -16,6 +21,16 @@ class Socket {
     Delegates::ClientDelegate* client;
     Delegates::ServerDelegate* server;
 
+    // Sends a string kept in the coroutine frame.
+    Task<> sendOwned(std::string data) const {
+        co_await io->send(data);
+    }
+
+    // Sends a string kept in the coroutine frame, then receives a string.
+    Task<RecvResult> sendRecvOwned(std::string data, std::size_t size) const {
+        co_return co_await io->sendRecv(data, size);
+    }
+
 public:
     Socket(Delegates::HandleDelegate& handle, Delegates::IODelegate& io, Delegates::ClientDelegate& client,
         Delegates::ServerDelegate& server) :
@@ -36,12 +51,49 @@ public:
         handle->cancelIO();
     }
 
+    void setTimeout(std::chrono::milliseconds timeout) const {
+        handle->setTimeout(timeout);
+    }
+
+    // Sends a string. The data isn't copied, so it must stay valid until the task finishes.
     Task<> send(std::string_view data) const {
-        return io->send(std::string{ data });
+        return io->send(data);
+    }
+
+    // Sends a string that is moved into the task (e.g., a temporary that would not outlive it).
+    Task<> send(std::same_as<std::string> auto&& data) const {
+        return sendOwned(std::move(data));
+    }
+
+    Task<> sendSegmented(std::string_view data, std::size_t segmentSize) const {
+        return io->sendSegmented(std::string{ data }, segmentSize);
+    }
+
+    Task<RecvResult> recv(std::size_t size, std::stop_token stopToken = {}) const {
+        return io->recv(size, std::move(stopToken));
+    }
+
+    // Sends a string, then receives a string. As with send, the data must stay valid until the task finishes.
+    Task<RecvResult> sendRecv(std::string_view data, std::size_t size) const {
+        return io->sendRecv(data, size);
+    }
+
+    // Sends a string that is moved into the task, then receives a string.
+    Task<RecvResult> sendRecv(std::same_as<std::string> auto&& data, std::size_t size) const {
+        return sendRecvOwned(std::move(data), size);
+    }
+
+    Task<> recvStream(std::size_t size, RecvHandler handler) const {
+        return io->recvStream(size, std::move(handler));
+    }
+
+    Task<> sendFile(std::string_view path, SendFileHandler handler) const {
+        return io->sendFile(std::string{ path }, std::move(handler));
     }
 
-    Task<RecvResult> recv(std::size_t size) const {
-        return io->recv(size);
+    Task<> relay(const Socket& target, std::size_t sampleSize, RelayHandler handler,
+        std::stop_token stopToken = {}) const {
+        return io->relay(*target.io, sampleSize, std::move(handler), std::move(stopToken));
     }
 
     Task<> connect(const Device& device) const {
@@ -56,11 +108,23 @@ public:
         return server->accept();
     }
 
+    Task<> acceptStream(AcceptHandler handler) const {
+        return server->acceptStream(std::move(handler));
+    }
+
     Task<DgramRecvResult> recvFrom(std::size_t size) const {
         return server->recvFrom(size);
     }
 
+    Task<> recvFromStream(std::size_t size, DgramRecvHandler handler) const {
+        return server->recvFromStream(size, std::move(handler));
+    }
+
     Task<> sendTo(const Device& device, std::string_view data) const {
         return server->sendTo(device, std::string{ data });
     }
+
+    Task<> sendToSegmented(const Device& device, std::string_view data, std::size_t segmentSize) const {
+        return server->sendToSegmented(device, std::string{ data }, segmentSize);
+    }
 };
@@ -0,0 +1,143 @@
+// Copyright 2021-2024 Aidan Sun and the WhaleConnect contributors
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include <atomic>
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <optional>
+#include <stop_token>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "task.hpp"
+
+// Tasks awaited together by whenAll and whenAny.
+//
+// Each task is started by a detached coroutine that records its result, so the tasks run concurrently on the thread
+// that awaits them (each one runs until it first suspends before the next one is started). The awaiting coroutine is
+// resumed by whichever task finishes last.
+namespace TaskGroup {
+    // Value produced by a task, with a placeholder for void tasks.
+    template <class T>
+    using Value = std::conditional_t<std::is_void_v<T>, std::monostate, T>;
+
+    // Result of a task in a group.
+    template <class T>
+    struct Slot {
+        std::optional<Value<T>> value;
+        std::exception_ptr exception;
+    };
+
+    // State shared by the tasks of a group. Awaiting it suspends until all tasks have finished.
+    struct State {
+        // Unfinished tasks, plus one for the awaiting coroutine until it suspends. Atomic since tasks can move to other
+        // threads before they finish.
+        std::atomic_size_t remaining;
+        std::coroutine_handle<> waiter;
+
+        std::atomic_bool settled = false; // If a task has finished
+        std::size_t first = 0; // Index of the first task to finish
+        std::stop_source stopSource{ std::nostopstate }; // Stopped when the first task finishes, if set
+
+        explicit State(std::size_t numTasks) : remaining(numTasks + 1) {}
+
+        // Counts a task as finished, resuming the awaiting coroutine after the last one.
+        void finish() {
+            if (remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) waiter.resume();
+        }
+
+        [[nodiscard]] bool await_ready() const noexcept {
+            return false;
+        }
+
+        // Stays suspended unless all tasks have already finished.
+        bool await_suspend(std::coroutine_handle<> current) noexcept {
+            waiter = current;
+            return remaining.fetch_sub(1, std::memory_order_acq_rel) > 1;
+        }
+
+        void await_resume() const noexcept {}
+    };
+
+    // Runs a task of a group and records how it finished.
+    template <class T>
+    Task<> run(LazyTask<T>& task, Slot<T>& slot, State& state, std::size_t index) {
+        try {
+            if constexpr (std::is_void_v<T>) {
+                co_await task;
+                slot.value.emplace();
+            } else {
+                slot.value.emplace(co_await task);
+            }
+        } catch (...) {
+            slot.exception = std::current_exception();
+        }
+
+        if (!state.settled.exchange(true, std::memory_order_acq_rel)) {
+            state.first = index;
+            state.stopSource.request_stop();
+        }
+
+        state.finish();
+    }
+
+    // Starts the tasks of a group. If the group has a stop source, the tasks left once one has finished aren't started.
+    template <class T>
+    void start(std::vector<LazyTask<T>>& tasks, std::vector<Slot<T>>& slots, State& state) {
+        for (std::size_t i = 0; i < tasks.size(); i++) {
+            if (state.stopSource.stop_possible() && state.settled.load(std::memory_order_acquire)) state.finish();
+            else run(tasks[i], slots[i], state, i);
+        }
+    }
+}
+
+// Runs tasks concurrently and waits for all of them to finish. Returns their values in the order of the tasks. If any
+// of them threw an exception, the exception of the first one (in the order of the tasks) is rethrown once all are done.
+template <class T>
+Task<std::conditional_t<std::is_void_v<T>, void, std::vector<T>>> whenAll(std::vector<LazyTask<T>> tasks) {
+    std::vector<TaskGroup::Slot<T>> slots(tasks.size());
+    TaskGroup::State state{ tasks.size() };
+
+    TaskGroup::start(tasks, slots, state);
+    co_await state;
+
+    for (const auto& i : slots)
+        if (i.exception) std::rethrow_exception(i.exception);
+
+    if constexpr (!std::is_void_v<T>) {
+        std::vector<T> values;
+        values.reserve(slots.size());
+        for (auto& i : slots) values.push_back(std::move(*i.value));
+
+        co_return values;
+    }
+}
+
+// Runs tasks concurrently until one of them finishes, then cancels the others by requesting a stop through the stop
+// source, which the tasks should watch (e.g., by passing its token to their operations). Tasks that haven't started
+// by then are skipped. Returns the index of the first task to finish, with its value. Its exception is rethrown if it
+// threw one, those of the canceled tasks are discarded.
+//
+// The canceled tasks are still awaited since their operations refer to their frames, so this returns once they have
+// all stopped. There must be at least one task.
+template <class T>
+Task<std::conditional_t<std::is_void_v<T>, std::size_t, std::pair<std::size_t, T>>>
+whenAny(std::stop_source stopSource, std::vector<LazyTask<T>> tasks) {
+    std::vector<TaskGroup::Slot<T>> slots(tasks.size());
+    TaskGroup::State state{ tasks.size() };
+    state.stopSource = std::move(stopSource);
+
+    TaskGroup::start(tasks, slots, state);
+    co_await state;
+
+    auto& [value, exception] = slots[state.first];
+    if (exception) std::rethrow_exception(exception);
+
+    if constexpr (std::is_void_v<T>) co_return state.first;
+    else co_return std::pair{ state.first, std::move(*value) };
+}
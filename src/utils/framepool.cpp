@@ -0,0 +1,146 @@
+// Copyright 2021-2024 Aidan Sun and the WhaleConnect contributors
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "framepool.hpp"
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <vector>
+
+// Frame sizes are rounded up to multiples of the granularity
+constexpr std::size_t granularity = 64;
+constexpr std::size_t numSizeClasses = 64; // Frames up to 4 KiB are pooled
+
+// Most frames kept in each free list
+constexpr std::size_t maxFreeFrames = 1024;
+
+// Reused frames are counted per thread and added to the total in batches, so threads don't contend on the counter
+constexpr std::uint64_t pooledBatchSize = 1024;
+
+std::atomic_uint64_t numHeapAllocations = 0;
+std::atomic_uint64_t numPooledAllocations = 0;
+
+// Live frame counts of running threads, and the sum of the counts of threads that have exited
+std::mutex liveCountsMutex;
+std::vector<const std::atomic_int64_t*> liveCounts;
+std::atomic_int64_t exitedLiveFrames = 0;
+
+// Free frame, linked to the next one in its list.
+struct FreeFrame {
+    FreeFrame* next;
+};
+
+// Free lists of a thread.
+struct FreeLists {
+    std::array<FreeFrame*, numSizeClasses> heads{};
+    std::array<std::size_t, numSizeClasses> sizes{};
+    std::uint64_t pooled = 0; // Reused frames not yet added to the total
+
+    // Frames allocated minus frames freed on this thread (negative if it freed frames from other threads)
+    // Only written by this thread, other threads read it when adding up the counts.
+    std::atomic_int64_t live = 0;
+
+    FreeLists();
+
+    ~FreeLists();
+};
+
+thread_local FreeLists freeLists;
+
+// Set once the thread's free lists are destroyed, frames freed after that (e.g., by destructors of other thread-local
+// or static objects) go to the heap. This flag is trivially destructible so it can still be read then.
+thread_local bool freeListsDestroyed = false;
+
+FreeLists::FreeLists() {
+    std::scoped_lock lock{ liveCountsMutex };
+    liveCounts.push_back(&live);
+}
+
+FreeLists::~FreeLists() {
+    freeListsDestroyed = true;
+    numPooledAllocations.fetch_add(pooled, std::memory_order_relaxed);
+
+    {
+        std::scoped_lock lock{ liveCountsMutex };
+        std::erase(liveCounts, &live);
+        exitedLiveFrames.fetch_add(live.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+
+    for (FreeFrame* head : heads) {
+        while (head) ::operator delete(std::exchange(head, head->next));
+    }
+}
+
+// Adds to the number of live frames.
+void countLive(std::int64_t change) {
+    if (freeListsDestroyed) {
+        exitedLiveFrames.fetch_add(change, std::memory_order_relaxed);
+        return;
+    }
+
+    // The count has a single writer, so it doesn't need an atomic read-modify-write
+    freeLists.live.store(freeLists.live.load(std::memory_order_relaxed) + change, std::memory_order_relaxed);
+}
+
+// Gets the size class of a frame size, or numSizeClasses if it is too large to be pooled.
+std::size_t getSizeClass(std::size_t size) {
+    return size == 0 ? 0 : (size - 1) / granularity;
+}
+
+void* FramePool::allocate(std::size_t size) {
+    countLive(1);
+    std::size_t sizeClass = getSizeClass(size);
+
+    if (sizeClass < numSizeClasses && !freeListsDestroyed) {
+        if (FreeFrame* frame = freeLists.heads[sizeClass]) {
+            freeLists.heads[sizeClass] = frame->next;
+            freeLists.sizes[sizeClass]--;
+
+            if (++freeLists.pooled == pooledBatchSize)
+                numPooledAllocations.fetch_add(std::exchange(freeLists.pooled, 0), std::memory_order_relaxed);
+
+            return frame;
+        }
+
+        // Allocated with the full size of the class so it can be reused by any frame in it
+        size = (sizeClass + 1) * granularity;
+    }
+
+    numHeapAllocations.fetch_add(1, std::memory_order_relaxed);
+    return ::operator new(size);
+}
+
+void FramePool::deallocate(void* ptr, std::size_t size) noexcept {
+    countLive(-1);
+    std::size_t sizeClass = getSizeClass(size);
+
+    if (sizeClass < numSizeClasses && !freeListsDestroyed && freeLists.sizes[sizeClass] < maxFreeFrames) {
+        freeLists.heads[sizeClass] = new (ptr) FreeFrame{ freeLists.heads[sizeClass] };
+        freeLists.sizes[sizeClass]++;
+        return;
+    }
+
+    ::operator delete(ptr);
+}
+
+std::uint64_t FramePool::heapAllocations() {
+    return numHeapAllocations.load(std::memory_order_relaxed);
+}
+
+std::uint64_t FramePool::pooledAllocations() {
+    return numPooledAllocations.load(std::memory_order_relaxed);
+}
+
+std::int64_t FramePool::liveFrames() {
+    std::scoped_lock lock{ liveCountsMutex };
+
+    std::int64_t count = exitedLiveFrames.load(std::memory_order_relaxed);
+    for (const std::atomic_int64_t* i : liveCounts) count += i->load(std::memory_order_relaxed);
+
+    return count;
+}
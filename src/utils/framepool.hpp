@@ -0,0 +1,33 @@
+// Copyright 2021-2024 Aidan Sun and the WhaleConnect contributors
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Allocator for coroutine frames.
+//
+// Frames are rounded up to size classes, and freed frames are kept in per-thread free lists to be reused by the next
+// frame of the same class without locking or going through the global heap. Since coroutines can move between threads,
+// a frame may be freed on a different thread than the one that allocated it, it then goes to the freeing thread's
+// list. Each list holds a limited number of frames, the rest are returned to the heap. Frames larger than the biggest
+// size class always come from the heap.
+namespace FramePool {
+    // Allocates memory for a coroutine frame.
+    void* allocate(std::size_t size);
+
+    // Frees memory allocated by allocate() with the same size.
+    void deallocate(void* ptr, std::size_t size) noexcept;
+
+    // Gets the number of frames allocated with the global heap across all threads.
+    std::uint64_t heapAllocations();
+
+    // Gets the number of frames reused from the free lists across all threads. Each thread adds to it in batches, so it
+    // may lag behind.
+    std::uint64_t pooledAllocations();
+
+    // Gets the number of frames allocated and not yet freed across all threads (i.e., coroutines that haven't finished
+    // or whose tasks are still held). Useful for finding leaked coroutines in tests.
+    std::int64_t liveFrames();
+}
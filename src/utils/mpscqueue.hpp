@@ -0,0 +1,134 @@
+// Copyright 2021-2024 Aidan Sun and the WhaleConnect contributors
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+// A multi-producer, single-consumer queue backed by a bounded ring.
+// T: the type of the items in the queue
+// Capacity: the number of items the ring can hold, must be a power of 2
+//
+// Producers claim slots in the ring without locking (based on Dmitry Vyukov's bounded queue). If the ring is full,
+// items are appended to an overflow list protected by a mutex. Once an item has gone to the overflow list, producers
+// keep using it until the consumer takes it, and the consumer finishes the older ring items before the list. This way,
+// items pushed from the same thread are always consumed in order.
+template <class T, std::size_t Capacity>
+class MPSCQueue {
+    static_assert(std::has_single_bit(Capacity), "Capacity must be a power of 2");
+
+    static constexpr std::size_t mask = Capacity - 1;
+
+    // Slot in the ring.
+    // The sequence number tells which lap of the ring the slot is in and whether it is filled.
+    struct Cell {
+        std::atomic_size_t sequence;
+        std::optional<T> data;
+    };
+
+    std::unique_ptr<Cell[]> cells = std::make_unique<Cell[]>(Capacity);
+
+    // Positions are kept on separate cache lines to prevent false sharing between producers and the consumer
+    alignas(64) std::atomic_size_t enqueuePos = 0;
+    alignas(64) std::size_t dequeuePos = 0;
+
+    std::vector<T> overflow;
+    std::mutex overflowMutex;
+    std::atomic_bool hasOverflow = false;
+
+    // Attempts to push an item into the ring. Returns false if the ring is full.
+    bool tryPushRing(const T& item) {
+        std::size_t pos = enqueuePos.load(std::memory_order_relaxed);
+
+        while (true) {
+            Cell& cell = cells[pos & mask];
+            std::size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            auto diff = static_cast<std::intptr_t>(sequence) - static_cast<std::intptr_t>(pos);
+
+            if (diff == 0) {
+                // The slot is free in this lap, try to claim it
+                if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.data.emplace(item);
+                    cell.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                // The slot has not been consumed since the last lap
+                return false;
+            } else {
+                // Another producer claimed the slot, try again at the current position
+                pos = enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Attempts to pop an item from the ring and pass it to a function. Returns false if the next item is not available.
+    template <class Fn>
+    bool tryPopRing(Fn& fn) {
+        Cell& cell = cells[dequeuePos & mask];
+        if (cell.sequence.load(std::memory_order_acquire) != dequeuePos + 1) return false;
+
+        // Take the item out before releasing the slot so the function can push more items
+        T item = std::move(*cell.data);
+        cell.data.reset();
+        cell.sequence.store(dequeuePos + Capacity, std::memory_order_release);
+        dequeuePos++;
+
+        fn(item);
+        return true;
+    }
+
+public:
+    MPSCQueue() {
+        for (std::size_t i = 0; i < Capacity; i++) cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    // Adds an item to the queue. This function can be called from any thread.
+    void push(const T& item) {
+        if (!hasOverflow.load(std::memory_order_acquire) && tryPushRing(item)) return;
+
+        std::scoped_lock lock{ overflowMutex };
+        overflow.push_back(item);
+        hasOverflow.store(true, std::memory_order_release);
+    }
+
+    // Checks if the queue has no items. Must only be called from the consumer thread.
+    bool empty() const {
+        const Cell& cell = cells[dequeuePos & mask];
+        bool ringEmpty = cell.sequence.load(std::memory_order_acquire) != dequeuePos + 1;
+        return ringEmpty && !hasOverflow.load(std::memory_order_acquire);
+    }
+
+    // Removes all items from the queue, passing each one to a function. Must only be called from the consumer thread.
+    // Items pushed while this function is running may be left for the next call.
+    template <class Fn>
+    void drain(Fn fn) {
+        while (tryPopRing(fn)) {}
+
+        if (!hasOverflow.load(std::memory_order_acquire)) return;
+
+        std::vector<T> tmp;
+        std::size_t ringEnd;
+        {
+            std::scoped_lock lock{ overflowMutex };
+            std::swap(tmp, overflow);
+            ringEnd = enqueuePos.load(std::memory_order_relaxed);
+            hasOverflow.store(false, std::memory_order_release);
+        }
+
+        // Ring slots claimed before the overflow list was taken are older than the items in it. Some of them may have
+        // been claimed but not filled yet, so wait for them to be published.
+        while (dequeuePos != ringEnd)
+            if (!tryPopRing(fn)) std::this_thread::yield();
+
+        for (const auto& i : tmp) fn(i);
+    }
+};
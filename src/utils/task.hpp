@@ -3,14 +3,23 @@
 
 #pragma once
 
+#include <atomic>
 #include <coroutine>
+#include <cstddef>
 #include <exception>
 #include <type_traits>
 #include <utility>
 
+#include "framepool.hpp"
+
 // An asynchronous coroutine's return object.
 // T: the datatype of the value(s) produced by the coroutine
-template <class T = void>
+// Lazy: if the coroutine waits to be awaited before it starts (see LazyTask)
+//
+// The task object owns the coroutine's frame. If the coroutine has finished when the task object is destroyed (e.g.,
+// after it has been awaited), the frame is destroyed with it. Otherwise, the coroutine is detached and its frame is
+// destroyed once it finishes. Exceptions thrown in detached coroutines are discarded.
+template <class T = void, bool Lazy = false>
 class Task {
     // If this template type is void-returning
     static constexpr bool isVoid = std::is_void_v<T>;
@@ -44,6 +53,12 @@ class Task {
                 // Get the caller coroutine's handle
                 auto promiseContinuation = current.promise().continuation;
 
+                // Destroy the frame if the task object is gone (there is no caller coroutine in that case)
+                if (current.promise().release()) {
+                    current.destroy();
+                    return std::noop_coroutine();
+                }
+
                 // Return the handle, or a no-op handle if there is no caller coroutine
                 // Returning the caller's handle allows it to be resumed.
                 return promiseContinuation ? promiseContinuation : std::noop_coroutine();
@@ -58,15 +73,37 @@ class Task {
 
         std::exception_ptr exception; // Any exception that was thrown in the coroutine
 
+        bool started = !Lazy; // If the coroutine has been entered (lazy coroutines start when they are awaited)
+
+        // Set by whichever of the task object and the finished coroutine lets go of the frame first, the other one
+        // destroys it. Atomic since coroutines can finish on a different thread than the one holding the task object.
+        std::atomic_bool released = false;
+
+        // Lets go of the frame. Returns true if the frame should be destroyed.
+        bool release() noexcept {
+            return released.exchange(true, std::memory_order_acq_rel);
+        }
+
+        // Allocates the coroutine's frame. Frames are reused from a pool instead of going through the global heap
+        // every time.
+        static void* operator new(std::size_t size) {
+            return FramePool::allocate(size);
+        }
+
+        // Frees the coroutine's frame into the pool.
+        static void operator delete(void* ptr, std::size_t size) noexcept {
+            FramePool::deallocate(ptr, size);
+        }
+
         // Called first when a coroutine is entered. This specifies the Task object returned from a coroutine function.
         Task get_return_object() noexcept {
             return Task{ *this };
         }
 
         // Called second when a coroutine is entered. This dictates how the coroutine starts.
-        // Returning suspend_never starts the coroutine immediately.
-        [[nodiscard]] std::suspend_never initial_suspend() const noexcept {
-            return {};
+        // Returning suspend_never starts the coroutine immediately, suspend_always waits until it is awaited.
+        [[nodiscard]] auto initial_suspend() const noexcept {
+            return std::conditional_t<Lazy, std::suspend_always, std::suspend_never>{};
         }
 
         // Handles any exceptions thrown in a coroutine.
@@ -86,10 +123,35 @@ class Task {
     // Constructs a task object from a coroutine promise object.
     explicit Task(PromiseType& promiseType) : handle(std::coroutine_handle<PromiseType>::from_promise(promiseType)) {}
 
+    // Lets go of the frame, destroying it if the coroutine has finished or never started.
+    void reset() noexcept {
+        if (handle && (!handle.promise().started || handle.promise().release())) handle.destroy();
+    }
+
 public:
     // Type alias for the promise object for use by the compiler.
     using promise_type = PromiseType;
 
+    Task(Task&& other) noexcept : handle(std::exchange(other.handle, nullptr)) {}
+
+    Task& operator=(Task&& other) noexcept {
+        if (this != &other) {
+            reset();
+            handle = std::exchange(other.handle, nullptr);
+        }
+
+        return *this;
+    }
+
+    Task(const Task&) = delete;
+
+    Task& operator=(const Task&) = delete;
+
+    // Destroys the frame if the coroutine has finished (or never started), otherwise detaches the coroutine.
+    ~Task() {
+        reset();
+    }
+
     // The three await methods below allow us to co_await a task.
 
     // Determines whether the coroutine needs to be suspended.
@@ -102,9 +164,15 @@ public:
 
     // Keeps track of the current coroutine to resume on suspend.
     // Called when the coroutine is suspended.
-    void await_suspend(std::coroutine_handle<> current) const noexcept {
+    auto await_suspend(std::coroutine_handle<> current) const noexcept {
         // Keep track of the current coroutine so it can be resumed in final_suspend
         handle.promise().continuation = current;
+
+        // Lazy coroutines are started by switching to them
+        if constexpr (Lazy) {
+            handle.promise().started = true;
+            return std::coroutine_handle<>{ handle };
+        }
     }
 
     // Returns the result of the entire co_await expression (the value the coroutine produced).
@@ -117,3 +185,8 @@ public:
         if constexpr (!isVoid) return std::move(handle.promise().data);
     }
 };
+
+// A task whose coroutine doesn't start until it is awaited, so it can be created ahead of time and handed to something
+// else to run (e.g., whenAll). If the task object is destroyed before that, the coroutine never runs.
+template <class T = void>
+using LazyTask = Task<T, true>;
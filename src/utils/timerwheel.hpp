@@ -0,0 +1,158 @@
+// Copyright 2021-2024 Aidan Sun and the WhaleConnect contributors
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <utility>
+
+// A hierarchical timer wheel, which keeps any number of timers with constant-time arming and disarming.
+//
+// Time is measured in ticks. The wheel has several levels of slots, each slot on a level covering as many ticks as a
+// whole turn of the level below it. Timers are put in the lowest level that reaches their expiry, then moved down a
+// level each time the wheel reaches their slot, until they fire from the lowest level. Expiries further away than the
+// highest level reaches are moved down once they are in range.
+//
+// Timers are linked into the slots directly, so the wheel does not allocate memory. A timer must stay at the same
+// address while it is armed.
+class TimerWheel {
+public:
+    // A timer in the wheel.
+    struct Timer {
+        std::uint64_t expiry = 0; // The tick the timer fires at
+        Timer* prev = nullptr;
+        Timer* next = nullptr;
+        unsigned int slot = 0; // Index of the slot the timer is in (across all levels)
+        bool armed = false;
+    };
+
+private:
+    static constexpr unsigned int slotBits = 6;
+    static constexpr unsigned int numSlots = 1 << slotBits; // Slots per level, one bit each in the occupancy masks
+    static constexpr unsigned int numLevels = 4;
+    static constexpr std::uint64_t range = std::uint64_t{ 1 } << (slotBits * numLevels); // Ticks the wheel reaches
+
+    std::array<Timer*, numSlots * numLevels> slots{};
+    std::array<std::uint64_t, numLevels> occupied{}; // Slots with timers on each level
+    std::uint64_t current = 0; // The last tick that was processed
+    std::size_t count = 0;
+
+    // Puts a timer in the slot that is reached at (or in the last slot before) the target tick.
+    void link(Timer& timer, std::uint64_t target) {
+        target = std::min(target, current + range - 1);
+
+        unsigned int level = 0;
+        while (level < numLevels - 1 && target - current >= std::uint64_t{ 1 } << (slotBits * (level + 1))) level++;
+
+        auto index = static_cast<unsigned int>((target >> (slotBits * level)) & (numSlots - 1));
+        timer.slot = level * numSlots + index;
+        timer.prev = nullptr;
+        timer.next = slots[timer.slot];
+
+        if (timer.next) timer.next->prev = &timer;
+        slots[timer.slot] = &timer;
+        occupied[level] |= std::uint64_t{ 1 } << index;
+    }
+
+    // Takes a timer out of its slot.
+    void unlink(Timer& timer) {
+        if (timer.prev) timer.prev->next = timer.next;
+        else slots[timer.slot] = timer.next;
+
+        if (timer.next) timer.next->prev = timer.prev;
+
+        if (!slots[timer.slot]) occupied[timer.slot / numSlots] &= ~(std::uint64_t{ 1 } << (timer.slot % numSlots));
+    }
+
+public:
+    TimerWheel() = default;
+
+    TimerWheel(const TimerWheel&) = delete;
+
+    TimerWheel& operator=(const TimerWheel&) = delete;
+
+    // Arms a timer to fire at its expiry. Expiries that have passed fire on the next tick.
+    void add(Timer& timer) {
+        link(timer, std::max(timer.expiry, current + 1));
+        timer.armed = true;
+        count++;
+    }
+
+    // Disarms a timer if it is armed.
+    void remove(Timer& timer) {
+        if (!timer.armed) return;
+
+        unlink(timer);
+        timer.armed = false;
+        count--;
+    }
+
+    // Gets the next tick at which timers fire or move down a level, or nothing if no timers are armed.
+    std::optional<std::uint64_t> nextTick() const {
+        if (count == 0) return std::nullopt;
+
+        std::uint64_t next = std::numeric_limits<std::uint64_t>::max();
+        for (unsigned int level = 0; level < numLevels; level++) {
+            if (occupied[level] == 0) continue;
+
+            // Find the first occupied slot from the next one reached on this level
+            unsigned int shift = slotBits * level;
+            std::uint64_t first = (current >> shift) + 1;
+            auto offset = std::countr_zero(std::rotr(occupied[level], static_cast<int>(first & (numSlots - 1))));
+
+            next = std::min(next, (first + static_cast<unsigned int>(offset)) << shift);
+        }
+
+        return next;
+    }
+
+    // Processes ticks up to a given one, calling a function with each timer that fires. Timers fire in the order of
+    // their expiries (in no particular order within the same tick), and are disarmed before the function is called so
+    // it can arm them again.
+    template <class Fn>
+    void advance(std::uint64_t now, Fn fn) {
+        while (current < now) {
+            // Ticks without timers to process are skipped
+            current = std::min(now, nextTick().value_or(now));
+
+            // Move timers down from the slots reached on higher levels, starting from the highest so timers can be
+            // moved down through more than one level at once
+            for (unsigned int level = numLevels - 1; level > 0; level--) {
+                unsigned int shift = slotBits * level;
+                if (current & ((std::uint64_t{ 1 } << shift) - 1)) continue;
+
+                unsigned int slot = level * numSlots + static_cast<unsigned int>((current >> shift) & (numSlots - 1));
+                Timer* timer = std::exchange(slots[slot], nullptr);
+                occupied[level] &= ~(std::uint64_t{ 1 } << (slot % numSlots));
+
+                while (timer) {
+                    Timer* next = timer->next;
+                    link(*timer, std::max(timer->expiry, current));
+                    timer = next;
+                }
+            }
+
+            unsigned int slot = static_cast<unsigned int>(current & (numSlots - 1));
+            while (Timer* timer = slots[slot]) {
+                remove(*timer);
+                fn(*timer);
+            }
+        }
+    }
+
+    // Gets the number of armed timers.
+    std::size_t size() const {
+        return count;
+    }
+
+    // Checks if no timers are armed.
+    bool empty() const {
+        return count == 0;
+    }
+};
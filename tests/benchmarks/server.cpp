@@ -1,19 +1,37 @@
 // Copyright 2021-2024 Aidan Sun and the WhaleConnect contributors
 // SPDX-License-Identifier: GPL-3.0-or-later
 
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <charconv>
 #include <chrono>
+#include <cstddef>
 #include <cstdint>
 #include <cstring>
 #include <iostream>
 #include <latch>
 #include <list>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#if OS_LINUX
+#include <fstream>
+
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
 
 #include "net/enums.hpp"
 #include "os/async.hpp"
 #include "os/error.hpp"
 #include "sockets/delegates/delegates.hpp"
 #include "sockets/serversocket.hpp"
+#include "utils/framepool.hpp"
 #include "utils/task.hpp"
 
 struct Client {
@@ -25,75 +43,90 @@ struct Client {
 
 thread_local std::list<Client> clients;
 
-Task<> loop(SocketPtr& ptr) {
-    static const char* response = "HTTP/1.1 200 OK\r\nConnection: keep-alive\r\nContent-Length: 4\r\nContent-Type: "
-                                  "text/html\r\n\r\ntest\r\n\r\n";
+// Response to each request. It is set up before the server starts and sent without being copied, so the benchmark
+// only measures the I/O.
+std::string response = "HTTP/1.1 200 OK\r\nConnection: keep-alive\r\nContent-Length: 4\r\nContent-Type: text/html\r\n"
+                       "\r\ntest\r\n\r\n";
+
+std::atomic_uint64_t numRequests = 0;
+
+constexpr std::chrono::seconds runTime{ 10 };
+
+// Linked mode: each response is sent along with the receive of the next request
+bool linked = false;
 
+Task<> loop(SocketPtr ptr) {
     co_await Async::queueToThread();
     Client& client = clients.emplace_front(std::move(ptr), false);
 
-    while (true) {
-        try {
-            auto result = co_await client.sock->recv(1024);
-            if (result.closed) break;
+    try {
+        auto result = co_await client.sock->recv(1024);
 
-            if (result.data.ends_with("\r\n\r\n")) co_await client.sock->send(response);
-        } catch (const System::SystemError&) {
-            break;
+        while (!result.closed) {
+            if (!result.data.ends_with("\r\n\r\n")) {
+                result = co_await client.sock->recv(1024);
+            } else if (linked) {
+                // The response was sent once the next request is received
+                result = co_await client.sock->sendRecv(response, 1024);
+                numRequests.fetch_add(1, std::memory_order_relaxed);
+            } else {
+                co_await client.sock->send(response);
+                numRequests.fetch_add(1, std::memory_order_relaxed);
+                result = co_await client.sock->recv(1024);
+            }
         }
-    }
+    } catch (const System::SystemError&) {}
+
     client.done = true;
 }
 
-Task<> accept(const ServerSocket<SocketTag::IP>& sock, bool& pendingAccept) try {
-    auto [_, client] = co_await sock.accept();
-    pendingAccept = false;
-    co_await loop(client);
-} catch (const System::SystemError&) {
-    pendingAccept = false;
+bool accepting = false;
+
+// UDP mode: datagrams are counted instead of requests
+bool udp = false;
+
+Task<> accept(const ServerSocket<SocketTag::IP>& sock) {
+    accepting = true;
+
+    try {
+        co_await sock.acceptStream([](AcceptResult result) { loop(std::move(result.socket)); });
+    } catch (const System::SystemError&) {}
+
+    accepting = false;
 }
 
-void run() {
-    const ServerSocket<SocketTag::IP> s;
-    const std::uint16_t port = s.startServer({ ConnectionType::TCP, "", "0.0.0.0", 0 }).port;
-    std::cout << "port = " << port << "\n";
-
-    bool pendingAccept = false;
-
-    // Run for 10 seconds
-    using namespace std::literals;
-    const auto start = std::chrono::steady_clock::now();
-    while (true) {
-        bool timeout = std::chrono::steady_clock::now() - start > 10s;
-        if (timeout) {
-            s.cancelIO();
-            s.close();
-        }
+// Receives datagrams on the main thread, counting each one.
+Task<> recvDgrams(const ServerSocket<SocketTag::IP>& sock) {
+    accepting = true;
 
-        Async::handleEvents();
-        if (timeout) break;
+    try {
+        co_await sock.recvFromStream(2048, [](const DgramRecvResult&) {
+            numRequests.fetch_add(1, std::memory_order_relaxed);
+        });
+    } catch (const System::SystemError&) {}
 
-        if (!pendingAccept) {
-            pendingAccept = true;
-            accept(s, pendingAccept);
-        }
-    }
+    accepting = false;
 }
 
-int main(int argc, char** argv) {
-    // Get number of threads from first command line argument
-    unsigned int numThreads = 0;
-    if (argc > 1) {
-        char* arg = argv[1];
-        std::from_chars_result res = std::from_chars(arg, arg + std::strlen(arg), numThreads);
-        if (res.ec != std::errc{}) std::cout << "Invalid number of threads specified.\n";
-    }
+// Stops accepting clients once the run time is over.
+Task<> stopAccepting(const ServerSocket<SocketTag::IP>& s) {
+    co_await Async::sleep(runTime);
+    s.cancelIO();
+}
 
-    unsigned int realNumThreads = Async::init(numThreads, 2048);
-    std::cout << "Running with " << realNumThreads << " threads.\n";
+// Accepts clients (or receives datagrams) for the run time. The server socket is kept open so clients can reconnect to
+// it in the next run.
+void run(const ServerSocket<SocketTag::IP>& s) {
+    if (udp) recvDgrams(s);
+    else accept(s);
 
-    run();
+    stopAccepting(s);
 
+    while (accepting) Async::handleEvents();
+}
+
+// Closes the connected clients and waits for the worker threads to finish with them.
+void stopClients(unsigned int numThreads) {
     // Cancel remaining work on all threads
     Async::queueToThreadEx({}, []() -> Task<bool> {
         for (auto i = clients.begin(); i != clients.end(); i++)
@@ -102,17 +135,212 @@ int main(int argc, char** argv) {
         co_return false;
     });
 
-    std::latch threadWaiter{ realNumThreads - 1 };
+    std::latch threadWaiter{ numThreads - 1 };
     Async::queueToThreadEx({}, [&threadWaiter]() -> Task<bool> {
         if (clients.empty()) {
             threadWaiter.count_down();
             co_return false;
         }
 
+        // Check again after a while instead of re-queueing right away
         std::erase_if(clients, [](const Client& client) { return client.done; });
+        co_await Async::sleep(std::chrono::milliseconds{ 10 });
         co_return true;
     });
 
     threadWaiter.wait();
-    Async::cleanup();
+}
+
+#if OS_LINUX
+// Counts system calls made by this process through the raw_syscalls:sys_enter tracepoint. Threads created after the
+// counter is opened are included once they exit. This needs access to tracefs and perf events (usually root).
+class SyscallCounter {
+    int fd = -1;
+
+public:
+    SyscallCounter() {
+        std::uint64_t id = 0;
+        for (const char* path : { "/sys/kernel/tracing/events/raw_syscalls/sys_enter/id",
+                 "/sys/kernel/debug/tracing/events/raw_syscalls/sys_enter/id" })
+            if (std::ifstream{ path } >> id) break;
+
+        if (id == 0) return;
+
+        perf_event_attr attr{};
+        attr.type = PERF_TYPE_TRACEPOINT;
+        attr.size = sizeof(attr);
+        attr.config = id;
+        attr.inherit = 1;
+
+        fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+    }
+
+    ~SyscallCounter() {
+        if (fd >= 0) close(fd);
+    }
+
+    SyscallCounter(const SyscallCounter&) = delete;
+
+    SyscallCounter& operator=(const SyscallCounter&) = delete;
+
+    // Gets the number of system calls counted, or nothing if counting is unavailable.
+    std::optional<std::uint64_t> get() const {
+        std::uint64_t count = 0;
+        if (fd < 0 || read(fd, &count, sizeof(count)) != sizeof(count)) return std::nullopt;
+
+        return count;
+    }
+};
+#endif
+
+// Parses an unsigned number from a command line argument.
+bool parseNumber(std::string_view arg, auto& out) {
+    auto [_, ec] = std::from_chars(arg.data(), arg.data() + arg.size(), out);
+    return ec == std::errc{};
+}
+
+// Setup profiles that can be selected with --profile
+constexpr std::array<std::pair<std::string_view, Async::SetupProfile>, 3> setupProfiles{ {
+    { "default", Async::SetupProfile::Default },
+    { "throughput", Async::SetupProfile::Throughput },
+    { "latency", Async::SetupProfile::Latency },
+} };
+
+int main(int argc, char** argv) {
+    Async::Config config{ .queueEntries = 2048 };
+    unsigned int payloadSize = 0;
+    std::vector<std::pair<std::string_view, Async::SetupProfile>> profiles{ setupProfiles.front() };
+
+    // Number of threads is the first command line argument, the rest are options
+    for (int i = 1; i < argc; i++) {
+        std::string_view arg = argv[i];
+        std::string_view next = i + 1 < argc ? argv[i + 1] : "";
+
+        if (arg == "--payload") {
+            // Large-payload mode: respond with a body of the given size in KiB
+            if (!parseNumber(next, payloadSize)) std::cout << "Invalid payload size specified.\n";
+            i++;
+        } else if (arg == "--zero-copy") {
+            // Zero-copy threshold in KiB
+            std::size_t threshold = 0;
+            if (!parseNumber(next, threshold)) std::cout << "Invalid zero-copy threshold specified.\n";
+            config.zeroCopyThreshold = threshold * 1024;
+            i++;
+        } else if (arg == "--sqpoll") {
+            // Submission queue polling
+            config.sqPoll = true;
+        } else if (arg == "--sqpoll-cpu") {
+            // CPU to pin the first submission queue polling thread to
+            if (!parseNumber(next, config.sqPollCPU)) std::cout << "Invalid polling CPU specified.\n";
+            i++;
+        } else if (arg == "--backend") {
+            // I/O backend
+            if (next == "epoll") config.backend = Async::Backend::Epoll;
+            else if (next != "io_uring") std::cout << "Invalid backend specified.\n";
+            i++;
+        } else if (arg == "--linked") {
+            // Linked mode: send each response linked with the receive of the next request
+            linked = true;
+        } else if (arg == "--udp") {
+            // Datagram mode: count datagrams received instead of serving HTTP requests
+            udp = true;
+        } else if (arg == "--profile") {
+            // io_uring setup profile, or all of them one after another
+            auto it = std::ranges::find(setupProfiles, next, &std::pair<std::string_view, Async::SetupProfile>::first);
+
+            if (next == "all") profiles.assign(setupProfiles.begin(), setupProfiles.end());
+            else if (it != setupProfiles.end()) profiles = { *it };
+            else std::cout << "Invalid setup profile specified.\n";
+            i++;
+        } else if (!parseNumber(arg, config.numThreads)) {
+            std::cout << "Invalid number of threads specified.\n";
+        }
+    }
+
+    if (payloadSize > 0) {
+        std::string body(payloadSize * 1024, 'a');
+        response = "HTTP/1.1 200 OK\r\nConnection: keep-alive\r\nContent-Length: " + std::to_string(body.size())
+            + "\r\nContent-Type: text/plain\r\n\r\n" + body;
+    }
+
+#if OS_LINUX
+    // Opened before the worker threads are created so they are counted
+    SyscallCounter syscalls;
+    std::uint64_t prevSyscalls = 0;
+#endif
+
+    // The server is started after the first event loops are set up and is used for all runs
+    std::optional<ServerSocket<SocketTag::IP>> server;
+    std::vector<std::uint64_t> results;
+    std::uint64_t prevHeapFrames = 0;
+    std::uint64_t prevPooledFrames = 0;
+
+    for (const auto& [name, profile] : profiles) {
+        config.setupProfile = profile;
+        unsigned int realNumThreads = Async::init(config);
+
+        if (!server) {
+            server.emplace();
+            ConnectionType type = udp ? ConnectionType::UDP : ConnectionType::TCP;
+            std::cout << "port = " << server->startServer({ type, "", "0.0.0.0", 0 }).port << "\n";
+        }
+
+        std::cout << "Running with " << realNumThreads << " threads and the " << name << " profile.\n";
+
+#if OS_LINUX
+        // io_uring falls back to epoll if it is unavailable
+        bool epoll = Async::currentEventLoop().getBackend() == Async::Backend::Epoll;
+        std::cout << "Backend: " << (epoll ? "epoll" : "io_uring") << "\n";
+#endif
+
+        numRequests = 0;
+        run(*server);
+
+        std::cout << (udp ? "Datagrams received: " : "Requests served: ") << numRequests << " ("
+                  << numRequests / runTime.count() << " per second)\n";
+        results.push_back(numRequests);
+
+        stopClients(realNumThreads);
+
+        // The main thread's event loop is destroyed by the cleanup along with the operations still on it, so they are
+        // finished first (e.g., closes of sockets that were registered on it, which would stay open into the next run)
+        while (Async::currentEventLoop().size() > 0 || Async::currentEventLoop().hasQueuedOperations())
+            Async::handleEvents(false);
+
+        Async::cleanup();
+
+        // Steady-state I/O should reuse pooled frames, only setting up connections and threads takes new ones. Every
+        // coroutine of the run has finished, so no frames should be left.
+        std::uint64_t heapFrames = FramePool::heapAllocations() - std::exchange(prevHeapFrames,
+            FramePool::heapAllocations());
+        std::uint64_t pooledFrames = FramePool::pooledAllocations() - std::exchange(prevPooledFrames,
+            FramePool::pooledAllocations());
+
+        double heapPerRequest = numRequests > 0 ? static_cast<double>(heapFrames) / numRequests : 0;
+        std::cout << "Coroutine frames: " << heapFrames << " from the heap (" << heapPerRequest << " per "
+                  << (udp ? "datagram" : "request") << "), " << pooledFrames << " reused, "
+                  << FramePool::liveFrames() << " live\n";
+
+#if OS_LINUX
+        // Includes starting up and shutting down, which are negligible compared to the requests
+        if (auto count = syscalls.get()) {
+            std::uint64_t runSyscalls = *count - prevSyscalls;
+            double perRequest = numRequests > 0 ? static_cast<double>(runSyscalls) / numRequests : 0;
+            std::cout << "System calls: " << runSyscalls << " (" << perRequest << " per "
+                      << (udp ? "datagram" : "request") << ")\n";
+            prevSyscalls = *count;
+        } else {
+            std::cout << "System calls: unavailable (needs access to perf events and tracefs)\n";
+        }
+#endif
+    }
+
+    server->close();
+    Async::handleEvents(false);
+
+    if (profiles.size() > 1) {
+        std::cout << (udp ? "\nDatagrams" : "\nRequests") << " per second by profile:\n";
+        for (std::size_t i = 0; i < profiles.size(); i++)
+            std::cout << "  " << profiles[i].first << ": " << results[i] / runTime.count() << "\n";
+    }
 }
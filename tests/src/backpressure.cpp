@@ -0,0 +1,50 @@
+// Copyright 2021-2024 Aidan Sun and the WhaleConnect contributors
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include <algorithm>
+#include <cstddef>
+#include <string_view>
+#include <vector>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "helpers/helpers.hpp"
+#include "os/async.hpp"
+#include "os/errcheck.hpp"
+#include "utils/task.hpp"
+
+#if OS_LINUX
+#include <fcntl.h>
+#include <unistd.h>
+
+// Writes data to a descriptor, counting each time the write completes.
+Task<> writeAndCount(int fd, std::string_view data, int& numCompletions) {
+    co_await Async::run([fd, data](Async::CompletionResult& result) {
+        Async::submit(Async::Write{ { fd, &result }, data });
+    });
+
+    numCompletions++;
+}
+
+TEST_CASE("Full queues") {
+    // The tests' rings have 128 submission queue entries and the default 4096 completion queue entries. The writes
+    // finish right away, so they fill the submission queue many times over in one iteration and overflow the
+    // completion queue before their completions are handled.
+    constexpr std::size_t numWrites = 10000;
+
+    int fd = check(open("/dev/null", O_WRONLY | O_CLOEXEC));
+
+    std::vector<int> numCompletions(numWrites);
+    for (auto& i : numCompletions) writeAndCount(fd, "data", i);
+
+    auto numFinished = [&numCompletions] { return std::ranges::count_if(numCompletions, [](int i) { return i > 0; }); };
+    waitUntil([&] { return numFinished() == static_cast<std::ptrdiff_t>(numWrites); });
+
+    // Every write completes exactly once, with nothing left waiting or deferred
+    for (int i = 0; i < 10; i++) Async::handleEvents(false);
+    CHECK(std::ranges::all_of(numCompletions, [](int i) { return i == 1; }));
+    CHECK(Async::currentEventLoop().size() == 0);
+
+    close(fd);
+}
+#endif
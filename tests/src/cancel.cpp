@@ -1,18 +1,36 @@
 // Copyright 2021-2024 Aidan Sun and the WhaleConnect contributors
 // SPDX-License-Identifier: GPL-3.0-or-later
 
+#include <stop_token>
 #include <string>
 
 #include <catch2/catch_test_macros.hpp>
 
 #include "helpers/helpers.hpp"
+#include "helpers/testio.hpp"
 #include "net/enums.hpp"
 #include "os/async.hpp"
 #include "os/error.hpp"
 #include "sockets/clientsocket.hpp"
+#include "sockets/delegates/delegates.hpp"
 #include "utils/settingsparser.hpp"
 #include "utils/task.hpp"
 
+// Receives data, checking that the receive is canceled instead (by a stop or by canceling the socket's I/O).
+Task<> recvCanceled(const Socket& socket, std::stop_token stopToken, bool& stopped) {
+    try {
+        co_await socket.recv(4, stopToken);
+    } catch (const System::SystemError& e) {
+        CHECK(e.isCanceled());
+        stopped = true;
+    }
+}
+
+// Receives data into a string.
+Task<> recvInto(const Socket& socket, std::string& received) {
+    received = (co_await socket.recv(4)).data;
+}
+
 TEST_CASE("Cancellation") {
     SettingsParser parser;
     parser.load(SETTINGS_FILE);
@@ -26,18 +44,11 @@ TEST_CASE("Cancellation") {
     // Connect
     runSync([&]() -> Task<> { co_await sock.connect({ ConnectionType::TCP, "", v4Addr, tcpPort }); });
 
-    bool running = true;
-    [&]() -> Task<> {
-        try {
-            co_await sock.recv(4);
-        } catch (const System::SystemError& e) {
-            CHECK(e.isCanceled());
-            running = false;
-        }
-    }();
+    bool stopped = false;
+    recvCanceled(sock, {}, stopped);
 
     int iterations = 0;
-    while (running) {
+    while (!stopped) {
         using namespace std::literals;
 
         Async::handleEvents(false);
@@ -46,3 +57,26 @@ TEST_CASE("Cancellation") {
         iterations++;
     }
 }
+
+TEST_CASE("Cancel one operation") {
+    LocalConnection local;
+    auto& [_, client, accepted] = local;
+
+    // Start two receives on the same socket, only the first one can be stopped
+    std::stop_source stopSource;
+    bool stopped = false;
+    recvCanceled(client, stopSource.get_token(), stopped);
+
+    std::string received;
+    recvInto(client, received);
+
+    stopSource.request_stop();
+    waitUntil([&] { return stopped; });
+
+    // The other receive is still waiting and gets the data sent afterward
+    CHECK(received.empty());
+    runSync([&]() -> Task<> { co_await accepted->send("data"); });
+
+    waitUntil([&] { return !received.empty(); });
+    CHECK(received == "data");
+}
@@ -0,0 +1,113 @@
+// Copyright 2021-2024 Aidan Sun and the WhaleConnect contributors
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include <chrono>
+#include <stdexcept>
+#include <stop_token>
+#include <string>
+#include <vector>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "helpers/helpers.hpp"
+#include "helpers/testio.hpp"
+#include "os/async.hpp"
+#include "sockets/clientsocket.hpp"
+#include "sockets/delegates/delegates.hpp"
+#include "utils/combinators.hpp"
+#include "utils/task.hpp"
+
+// Waits for a number of milliseconds, then returns the number.
+LazyTask<int> sleepFor(int ms, int& numFinished) {
+    co_await Async::sleep(std::chrono::milliseconds{ ms });
+    numFinished++;
+    co_return ms;
+}
+
+// Waits for a number of milliseconds, then throws an exception.
+LazyTask<int> sleepAndFail(int ms, int& numFinished) {
+    co_await Async::sleep(std::chrono::milliseconds{ ms });
+    numFinished++;
+    throw std::runtime_error{ "test" };
+}
+
+// Receives data, or an empty string if a stop is requested first.
+LazyTask<std::string> recvOrStop(const Socket& socket, std::stop_token stopToken) {
+    co_return (co_await socket.recv(4, stopToken)).data;
+}
+
+// Waits for a duration, or until a stop is requested, then returns an empty string.
+LazyTask<std::string> timeout(std::chrono::milliseconds duration, std::stop_token stopToken) {
+    co_await Async::sleep(duration, stopToken);
+    co_return "";
+}
+
+TEST_CASE("Wait for all tasks") {
+    // Values are returned in the order of the tasks, not the order they finished in
+    int numFinished = 0;
+    std::vector<int> values;
+    runSync([&]() -> Task<> {
+        std::vector<LazyTask<int>> tasks;
+        tasks.push_back(sleepFor(20, numFinished));
+        tasks.push_back(sleepFor(10, numFinished));
+        tasks.push_back(sleepFor(0, numFinished));
+
+        values = co_await whenAll(std::move(tasks));
+    });
+
+    CHECK(values == std::vector{ 20, 10, 0 });
+    CHECK(numFinished == 3);
+
+    // An exception is only rethrown once every task has finished
+    numFinished = 0;
+    bool threw = false;
+    runSync([&]() -> Task<> {
+        std::vector<LazyTask<int>> tasks;
+        tasks.push_back(sleepAndFail(0, numFinished));
+        tasks.push_back(sleepFor(10, numFinished));
+
+        try {
+            co_await whenAll(std::move(tasks));
+        } catch (const std::runtime_error&) {
+            threw = true;
+        }
+    });
+
+    CHECK(threw);
+    CHECK(numFinished == 2);
+}
+
+TEST_CASE("Race tasks") {
+    using namespace std::literals;
+
+    LocalConnection local;
+    auto& [_, client, accepted] = local;
+
+    // Nothing is sent, so the timer wins and the receive is canceled
+    runSync([&]() -> Task<> {
+        std::stop_source stopSource;
+        std::vector<LazyTask<std::string>> tasks;
+        tasks.push_back(recvOrStop(client, stopSource.get_token()));
+        tasks.push_back(timeout(10ms, stopSource.get_token()));
+
+        auto [index, data] = co_await whenAny(stopSource, std::move(tasks));
+        CHECK(index == 1);
+    });
+
+    // Data arrives before the timer fires, the timer is stopped instead of being waited out
+    runSync([&]() -> Task<> { co_await accepted->send("data"); });
+
+    auto start = std::chrono::steady_clock::now();
+    runSync([&]() -> Task<> {
+        std::stop_source stopSource;
+        std::vector<LazyTask<std::string>> tasks;
+        tasks.push_back(recvOrStop(client, stopSource.get_token()));
+        tasks.push_back(timeout(10s, stopSource.get_token()));
+
+        auto [index, data] = co_await whenAny(stopSource, std::move(tasks));
+        CHECK(index == 0);
+        CHECK(data == "data");
+    });
+
+    CHECK(std::chrono::steady_clock::now() - start < 5s);
+}
@@ -0,0 +1,51 @@
+// Copyright 2021-2024 Aidan Sun and the WhaleConnect contributors
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include <cstddef>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <optional>
+#include <string>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "os/async.hpp"
+#include "os/filewriter.hpp"
+
+TEST_CASE("File writer") {
+    const auto path = std::filesystem::temp_directory_path() / "whaleconnect-filewriter-test.bin";
+    std::filesystem::remove(path);
+
+    // Many small writes are given at once, most of them while earlier ones are in progress
+    std::string expected;
+    {
+        FileWriter writer{ path.string() };
+        for (int i = 0; i < 10000; i++) {
+            std::string data = std::to_string(i) + ",";
+            writer.write(data);
+            expected += data;
+        }
+
+        while (writer.getNumWritten() < expected.size() && !writer.getError()) Async::handleEvents(false);
+
+        CHECK(writer.getError() == std::nullopt);
+        CHECK(writer.getNumDropped() == 0);
+    }
+
+    // The file is appended to, not replaced, when it is opened again
+    {
+        FileWriter writer{ path.string() };
+        writer.write("end");
+        expected += "end";
+
+        while (writer.getNumWritten() < 3) Async::handleEvents(false);
+    }
+
+    std::ifstream file{ path, std::ios::binary };
+    std::string contents{ std::istreambuf_iterator<char>{ file }, {} };
+    CHECK(contents == expected);
+
+    file.close();
+    std::filesystem::remove(path);
+}
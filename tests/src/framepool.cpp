@@ -0,0 +1,74 @@
+// Copyright 2021-2024 Aidan Sun and the WhaleConnect contributors
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "os/async.hpp"
+#include "utils/framepool.hpp"
+#include "utils/task.hpp"
+
+TEST_CASE("Frame pool") {
+    // A freed frame is reused by the next one in its size class without going to the heap
+    void* first = FramePool::allocate(180);
+    FramePool::deallocate(first, 180);
+
+    std::uint64_t heapAllocations = FramePool::heapAllocations();
+    void* second = FramePool::allocate(170);
+    CHECK(second == first);
+    CHECK(FramePool::heapAllocations() == heapAllocations);
+    FramePool::deallocate(second, 170);
+
+    // Frames too large to be pooled always come from the heap
+    constexpr std::size_t largeSize = 64 * 1024;
+    for (int i = 0; i < 2; i++) FramePool::deallocate(FramePool::allocate(largeSize), largeSize);
+
+    CHECK(FramePool::heapAllocations() == heapAllocations + 2);
+}
+
+// Waits, then returns a value.
+Task<int> sleepAndReturn(int value) {
+    co_await Async::sleep(std::chrono::milliseconds{ 1 });
+    co_return value;
+}
+
+// Waits, then throws an exception.
+Task<> sleepAndThrow() {
+    co_await Async::sleep(std::chrono::milliseconds{ 1 });
+    throw std::runtime_error{ "test" };
+}
+
+// Awaits coroutines that return and throw.
+Task<> awaitBoth(int& result, bool& done) {
+    result = co_await sleepAndReturn(1);
+
+    try {
+        co_await sleepAndThrow();
+    } catch (const std::runtime_error&) {
+        result++;
+    }
+
+    done = true;
+}
+
+TEST_CASE("Coroutine frames") {
+    const auto liveFrames = FramePool::liveFrames();
+
+    // Awaited coroutines are destroyed by the tasks awaiting them, detached ones destroy themselves once they finish
+    // (discarding their exceptions)
+    int result = 0;
+    bool done = false;
+    awaitBoth(result, done);
+    sleepAndThrow();
+
+    CHECK(FramePool::liveFrames() > liveFrames);
+
+    for (int i = 0; i < 100 && (!done || FramePool::liveFrames() > liveFrames); i++) Async::handleEvents();
+
+    CHECK(result == 2);
+    CHECK(FramePool::liveFrames() == liveFrames);
+}
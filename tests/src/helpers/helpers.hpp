@@ -4,6 +4,8 @@
 #pragma once
 
 #include <atomic>
+#include <chrono>
+#include <concepts>
 #include <coroutine>
 #include <exception>
 #include <type_traits>
@@ -12,6 +14,8 @@
 #include <CoreFoundation/CoreFoundation.h>
 #endif
 
+#include <catch2/catch_test_macros.hpp>
+
 #include "os/async.hpp"
 #include "utils/task.hpp"
 
@@ -19,8 +23,35 @@
 template <class T>
 concept Awaitable = requires (T) { typename std::coroutine_traits<std::invoke_result_t<T>>::promise_type; };
 
+// Awaits a coroutine, storing any exception it throws, then signals its completion.
+// The state is passed as parameters since they are kept in the coroutine frame (unlike a lambda's captures, which are
+// gone once the lambda object is destroyed, which happens before the coroutine is resumed).
+Task<> runAndSignal(const Awaitable auto& fn, std::exception_ptr& ptr, std::atomic_bool& completed, bool hasRunLoop) {
+    try {
+        // Await the given coroutine
+        co_await fn();
+    } catch (const std::exception&) {
+        // Store thrown exceptions
+        ptr = std::current_exception();
+    }
+
+    // Either the coroutine finished, or it threw an exception
+    if (hasRunLoop) {
+#if OS_MACOS
+        CFRunLoopStop(CFRunLoopGetCurrent());
+#endif
+    } else {
+        completed = true;
+    }
+}
+
 // Runs a coroutine synchronously.
 // Bluetooth functions on macOS require a run loop for events.
+//
+// The lambda is kept alive until its coroutine finishes, so it can use its captures. Coroutines that keep running
+// after the statement starting them (e.g., to receive in the background while a test sends) can't be lambdas with
+// captures since the lambdas are destroyed first. They are functions that take their state as parameters instead,
+// which are kept in their frames.
 void runSync(const Awaitable auto& fn, bool useRunLoop = false) {
     bool hasRunLoop = OS_MACOS && useRunLoop;
 
@@ -32,24 +63,7 @@ void runSync(const Awaitable auto& fn, bool useRunLoop = false) {
     std::exception_ptr ptr;
 
     // Run an outer coroutine, but don't await it
-    [&]() -> Task<> {
-        try {
-            // Await the given coroutine
-            co_await fn();
-        } catch (const std::exception&) {
-            // Store thrown exceptions
-            ptr = std::current_exception();
-        }
-
-        // Either the coroutine finished, or it threw an exception
-        if (hasRunLoop) {
-#if OS_MACOS
-            CFRunLoopStop(CFRunLoopGetCurrent());
-#endif
-        } else {
-            completed = true;
-        }
-    }();
+    runAndSignal(fn, ptr, completed, hasRunLoop);
 
     // Wait for the completion condition
     if (hasRunLoop) {
@@ -65,3 +79,14 @@ void runSync(const Awaitable auto& fn, bool useRunLoop = false) {
     // Rethrow any exceptions
     if (ptr) std::rethrow_exception(ptr);
 }
+
+// Handles events until a condition is met. The test fails if it takes longer than the time limit (e.g., if an
+// operation never finishes) instead of waiting forever.
+void waitUntil(const std::predicate auto& condition, std::chrono::seconds timeLimit = std::chrono::seconds{ 10 }) {
+    const auto deadline = std::chrono::steady_clock::now() + timeLimit;
+    while (!condition()) {
+        if (std::chrono::steady_clock::now() > deadline) FAIL("Timed out waiting for events");
+
+        Async::handleEvents();
+    }
+}
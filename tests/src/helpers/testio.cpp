@@ -1,10 +1,18 @@
 // Copyright 2021-2024 Aidan Sun and the WhaleConnect contributors
 // SPDX-License-Identifier: GPL-3.0-or-later
 
+#include "testio.hpp"
+
+#include <cstdint>
+
 #include <catch2/catch_test_macros.hpp>
 
 #include "helpers.hpp"
 #include "net/device.hpp"
+#include "net/enums.hpp"
+#include "sockets/clientsocket.hpp"
+#include "sockets/delegates/delegates.hpp"
+#include "sockets/serversocket.hpp"
 #include "sockets/socket.hpp"
 #include "utils/task.hpp"
 
@@ -32,3 +40,16 @@ void testIOClient(const Socket& socket, const Device& device, bool useRunLoop) {
 
     testIO(socket, useRunLoop);
 }
+
+LocalServer::LocalServer() : port(server.startServer({ ConnectionType::TCP, "", "127.0.0.1", 0 }).port) {}
+
+SocketPtr LocalServer::connect(const ClientSocketIP& client) const {
+    // The connection waits in the server's backlog until it is accepted
+    SocketPtr accepted;
+    runSync([&]() -> Task<> {
+        co_await client.connect({ ConnectionType::TCP, "", "127.0.0.1", port });
+        accepted = (co_await server.accept()).socket;
+    });
+
+    return accepted;
+}
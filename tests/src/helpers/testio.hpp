@@ -3,7 +3,13 @@
 
 #pragma once
 
+#include <cstdint>
+
 #include "net/device.hpp"
+#include "net/enums.hpp"
+#include "sockets/clientsocket.hpp"
+#include "sockets/delegates/delegates.hpp"
+#include "sockets/serversocket.hpp"
 #include "sockets/socket.hpp"
 
 // Performs basic I/O checks on a socket.
@@ -11,3 +17,22 @@ void testIO(const Socket& socket, bool useRunLoop = false);
 
 // Connects a socket, then performs I/O checks.
 void testIOClient(const Socket& socket, const Device& device, bool useRunLoop = false);
+
+// TCP server on the loopback address for tests that don't need an external server.
+class LocalServer {
+    ServerSocket<SocketTag::IP> server;
+    std::uint16_t port;
+
+public:
+    LocalServer();
+
+    // Connects a client to the server and accepts it. Returns the accepted socket.
+    SocketPtr connect(const ClientSocketIP& client) const;
+};
+
+// Client connected to a local server, with the server's socket for the connection.
+struct LocalConnection {
+    LocalServer server;
+    ClientSocketIP client;
+    SocketPtr accepted = server.connect(client);
+};
@@ -0,0 +1,47 @@
+// Copyright 2021-2024 Aidan Sun and the WhaleConnect contributors
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include <algorithm>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "utils/mpscqueue.hpp"
+
+TEST_CASE("MPSC queue") {
+    struct Item {
+        std::size_t producer;
+        std::size_t sequence;
+    };
+
+    // A small ring forces producers onto the overflow path
+    constexpr std::size_t itemsPerProducer = 100000;
+    const std::size_t numProducers = std::max(std::thread::hardware_concurrency(), 2U);
+    MPSCQueue<Item, 64> queue;
+
+    std::vector<std::jthread> producers;
+    for (std::size_t i = 0; i < numProducers; i++)
+        producers.emplace_back([&queue, i] {
+            for (std::size_t j = 0; j < itemsPerProducer; j++) queue.push({ i, j });
+        });
+
+    // Consume concurrently with the producers, checking that each producer's items arrive in order
+    std::vector<std::size_t> nextSequence(numProducers, 0);
+    std::size_t received = 0;
+    bool inOrder = true;
+
+    while (received < numProducers * itemsPerProducer) {
+        queue.drain([&](const Item& item) {
+            if (item.sequence != nextSequence[item.producer]) inOrder = false;
+
+            nextSequence[item.producer] = item.sequence + 1;
+            received++;
+        });
+    }
+
+    CHECK(inOrder);
+    CHECK(queue.empty());
+    CHECK(std::ranges::all_of(nextSequence, [](std::size_t i) { return i == itemsPerProducer; }));
+}
@@ -0,0 +1,98 @@
+// Copyright 2021-2024 Aidan Sun and the WhaleConnect contributors
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "helpers/helpers.hpp"
+#include "net/device.hpp"
+#include "net/enums.hpp"
+#include "net/netutils.hpp"
+#include "net/resolver.hpp"
+#include "os/error.hpp"
+#include "utils/task.hpp"
+
+TEST_CASE("Resolver cache") {
+    using enum ConnectionType;
+
+    // Stub resolver which knows one name, counting its lookups and the threads they run on
+    std::atomic_int numLookups = 0;
+    std::atomic_bool offThread = true;
+    const auto loopThread = std::this_thread::get_id();
+
+    auto lookup = [&](const Device& device, bool) {
+        numLookups++;
+        if (std::this_thread::get_id() == loopThread) offThread = false;
+
+        if (device.address == "flaky.test") throw System::SystemError{ EAI_AGAIN, System::ErrorType::AddrInfo };
+        if (device.address != "server.test") throw System::SystemError{ EAI_NONAME, System::ErrorType::AddrInfo };
+        return NetUtils::resolveAddr({ device.type, "", "127.0.0.1", device.port }, false);
+    };
+
+    SECTION("Results are cached") {
+        Resolver resolver{ lookup };
+
+        runSync([&]() -> Task<> {
+            auto first = co_await resolver.resolve({ TCP, "", "server.test", 80 });
+            CHECK(std::this_thread::get_id() == loopThread);
+
+            auto second = co_await resolver.resolve({ TCP, "", "server.test", 80 });
+            CHECK(first == second);
+
+            // Different ports and connection types are resolved separately
+            co_await resolver.resolve({ TCP, "", "server.test", 81 });
+            co_await resolver.resolve({ UDP, "", "server.test", 80 });
+        });
+
+        CHECK(numLookups == 3);
+        CHECK(offThread);
+    }
+
+    SECTION("Failures are cached") {
+        Resolver resolver{ lookup };
+
+        runSync([&]() -> Task<> {
+            for (int i = 0; i < 2; i++) {
+                try {
+                    co_await resolver.resolve({ TCP, "", "unknown.test", 80 });
+                    FAIL("Unknown name was resolved");
+                } catch (const System::SystemError& e) {
+                    CHECK(e.code == EAI_NONAME);
+                }
+            }
+        });
+
+        CHECK(numLookups == 1);
+    }
+
+    SECTION("Temporary failures aren't cached") {
+        Resolver resolver{ lookup };
+
+        runSync([&]() -> Task<> {
+            for (int i = 0; i < 2; i++) {
+                try {
+                    co_await resolver.resolve({ TCP, "", "flaky.test", 80 });
+                    FAIL("Name was resolved after a temporary failure");
+                } catch (const System::SystemError& e) {
+                    CHECK(e.code == EAI_AGAIN);
+                }
+            }
+        });
+
+        CHECK(numLookups == 2);
+    }
+
+    SECTION("Results expire") {
+        Resolver resolver{ lookup, std::chrono::milliseconds{ 0 } };
+
+        runSync([&]() -> Task<> {
+            co_await resolver.resolve({ TCP, "", "server.test", 80 });
+            co_await resolver.resolve({ TCP, "", "server.test", 80 });
+        });
+
+        CHECK(numLookups == 2);
+    }
+}
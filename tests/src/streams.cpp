@@ -0,0 +1,402 @@
+// Copyright 2021-2024 Aidan Sun and the WhaleConnect contributors
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <stop_token>
+#include <string>
+#include <vector>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "helpers/helpers.hpp"
+#include "helpers/testio.hpp"
+#include "net/enums.hpp"
+#include "os/async.hpp"
+#include "os/error.hpp"
+#include "sockets/clientsocket.hpp"
+#include "sockets/delegates/delegates.hpp"
+#include "sockets/serversocket.hpp"
+#include "utils/task.hpp"
+
+// Accepts clients from a stream until it is canceled.
+Task<> acceptAll(const ServerSocket<SocketTag::IP>& server, std::vector<SocketPtr>& accepted, bool& running) {
+    try {
+        co_await server.acceptStream([&accepted](AcceptResult result) {
+            accepted.push_back(std::move(result.socket));
+        });
+    } catch (const System::SystemError& e) {
+        CHECK(e.isCanceled());
+    }
+    running = false;
+}
+
+// Connects a client to a local server, then counts it as connected.
+Task<> connectAndCount(const ClientSocketIP& client, std::uint16_t port, int& numConnected) {
+    co_await client.connect({ ConnectionType::TCP, "", "127.0.0.1", port });
+    numConnected++;
+}
+
+TEST_CASE("Accept stream") {
+    using enum ConnectionType;
+
+    // Start a local server (no external server needed)
+    ServerSocket<SocketTag::IP> server;
+    const auto port = server.startServer({ TCP, "", "127.0.0.1", 0 }).port;
+
+    std::vector<SocketPtr> accepted;
+    bool running = true;
+    acceptAll(server, accepted, running);
+
+    // Connect multiple clients at once
+    std::array<ClientSocketIP, 4> clients;
+    int numConnected = 0;
+    for (auto& i : clients) connectAndCount(i, port, numConnected);
+
+    waitUntil([&] { return numConnected == static_cast<int>(clients.size()) && accepted.size() == clients.size(); });
+
+    // Every client is accepted from the same stream, which ends once canceled
+    CHECK(accepted.size() == clients.size());
+    CHECK(running);
+
+    server.cancelIO();
+    waitUntil([&] { return !running; });
+}
+
+// Receives in parts of at most 4 bytes until the connection is closed.
+Task<> recvInParts(const Socket& socket, std::string& received, bool& closed) {
+    co_await socket.recvStream(4, [&received, &closed](RecvResult result) {
+        // Results are limited to the requested size
+        CHECK(result.data.size() <= 4);
+
+        if (result.closed) closed = true;
+        else received += result.data;
+    });
+}
+
+TEST_CASE("Receive stream") {
+    LocalConnection local;
+    auto& [_, client, accepted] = local;
+
+    std::string received;
+    bool closed = false;
+    recvInParts(*accepted, received, closed);
+
+    // Multiple sends are delivered through the same stream, which ends when the peer closes the connection
+    const std::string data = "multishot receive test";
+    runSync([&]() -> Task<> {
+        co_await client.send(data.substr(0, 9));
+        co_await client.send(data.substr(9));
+    });
+
+    waitUntil([&] { return received.size() >= data.size(); });
+    CHECK(received == data);
+
+    client.close();
+    waitUntil([&] { return closed; });
+}
+
+// Receives datagrams of at most the given size until the operation is canceled.
+Task<> recvDgrams(const ServerSocket<SocketTag::IP>& server, std::size_t size, std::vector<DgramRecvResult>& received,
+    bool& running) {
+    try {
+        co_await server.recvFromStream(size, [&received](DgramRecvResult result) { received.push_back(result); });
+    } catch (const System::SystemError& e) {
+        CHECK(e.isCanceled());
+    }
+    running = false;
+}
+
+// Sends numbered datagrams to a server.
+Task<> sendDgrams(const ClientSocketIP& client, std::uint16_t port, std::size_t count) {
+    co_await client.connect({ ConnectionType::UDP, "", "127.0.0.1", port });
+    for (std::size_t i = 0; i < count; i++) co_await client.send("datagram " + std::to_string(i));
+}
+
+TEST_CASE("Receive datagram stream") {
+    using enum ConnectionType;
+
+    ServerSocket<SocketTag::IP> server;
+    const auto port = server.startServer({ UDP, "", "127.0.0.1", 0 }).port;
+
+    std::vector<DgramRecvResult> received;
+    bool running = true;
+    recvDgrams(server, 8, received, running);
+
+    // Datagrams sent one after another are delivered through the same stream
+    constexpr std::size_t count = 16;
+    ClientSocketIP client;
+    sendDgrams(client, port, count);
+
+    waitUntil([&] { return received.size() >= count; });
+
+    // Each datagram is truncated to the requested size and comes with its sender
+    for (const auto& [from, data] : received) {
+        CHECK(data == "datagram");
+        CHECK(from.type == UDP);
+        CHECK(from.address == "127.0.0.1");
+    }
+
+    CHECK(running);
+    server.cancelIO();
+    waitUntil([&] { return !running; });
+}
+
+// Sends segmented data to a server, then receives the datagrams it sends back.
+Task<> sendAndEcho(const ClientSocketIP& client, std::uint16_t port, std::string data, std::size_t segmentSize,
+    std::vector<std::string>& echoed) {
+    co_await client.connect({ ConnectionType::UDP, "", "127.0.0.1", port });
+    co_await client.sendSegmented(data, segmentSize);
+
+    for (std::size_t i = 0; i < data.size(); i += segmentSize) echoed.push_back((co_await client.recv(1024)).data);
+}
+
+// Sends the datagrams received by a server back to their sender as segmented data.
+Task<> echoSegmented(const ServerSocket<SocketTag::IP>& server, std::vector<DgramRecvResult> received,
+    std::size_t segmentSize) {
+    std::string data;
+    for (const auto& [_, datagram] : received) data += datagram;
+
+    co_await server.sendToSegmented(received.front().from, data, segmentSize);
+}
+
+TEST_CASE("Segmented datagrams") {
+    using enum ConnectionType;
+
+    ServerSocket<SocketTag::IP> server;
+    const auto port = server.startServer({ UDP, "", "127.0.0.1", 0 }).port;
+
+    std::vector<DgramRecvResult> received;
+    bool running = true;
+    recvDgrams(server, 1024, received, running);
+
+    // More datagrams than one segmented send can hold, with a shorter one at the end
+    constexpr std::size_t segmentSize = 100;
+    std::string data(segmentSize * 150 + 42, 0);
+    for (std::size_t i = 0; i < data.size(); i++) data[i] = static_cast<char>('a' + i / segmentSize % 26);
+
+    const std::size_t numDatagrams = (data.size() + segmentSize - 1) / segmentSize;
+
+    ClientSocketIP client;
+    std::vector<std::string> echoed;
+    sendAndEcho(client, port, data, segmentSize, echoed);
+
+    waitUntil([&] { return received.size() >= numDatagrams; });
+
+    // Datagrams coalesced by the kernel are split apart again, keeping their boundaries
+    std::string joined;
+    for (const auto& [_, datagram] : received) {
+        CHECK(datagram.size() <= segmentSize);
+        CHECK(datagram.find_first_not_of(datagram.front()) == std::string::npos);
+        joined += datagram;
+    }
+
+    CHECK(received.size() == numDatagrams);
+    CHECK(joined == data);
+
+    // The server sends them back the same way
+    echoSegmented(server, received, segmentSize);
+    waitUntil([&] { return echoed.size() >= numDatagrams; });
+
+    std::string joinedEcho;
+    for (const auto& i : echoed) joinedEcho += i;
+    CHECK(joinedEcho == data);
+
+    server.cancelIO();
+    waitUntil([&] { return !running; });
+}
+
+// Receives until the connection is closed.
+Task<> recvAll(const Socket& socket, std::string& received, bool& closed) {
+    co_await socket.recvStream(64 * 1024, [&received, &closed](RecvResult result) {
+        if (result.closed) closed = true;
+        else received += result.data;
+    });
+}
+
+// Sends a file, adding up the sizes of the parts sent.
+Task<> sendAndCount(const ClientSocketIP& client, std::string path, std::size_t& numSent, bool& done) {
+    co_await client.sendFile(path, [&numSent](std::size_t size) { numSent += size; });
+    done = true;
+}
+
+TEST_CASE("Send file") {
+    // Larger than a pipe's default capacity so the file is sent in more than one part
+    std::string contents(1024 * 1024 + 123, 0);
+    for (std::size_t i = 0; i < contents.size(); i++) contents[i] = static_cast<char>(i * 31 % 251);
+
+    const auto path = std::filesystem::temp_directory_path() / "whaleconnect-sendfile-test.bin";
+    std::ofstream{ path, std::ios::binary }.write(contents.data(), static_cast<std::streamsize>(contents.size()));
+
+    LocalConnection local;
+    auto& [server, client, accepted] = local;
+
+    std::string received;
+    bool closed = false;
+    recvAll(*accepted, received, closed);
+
+    std::size_t numSent = 0;
+    bool done = false;
+    sendAndCount(client, path.string(), numSent, done);
+
+    waitUntil([&] { return done && received.size() >= contents.size(); });
+    CHECK(received == contents);
+    CHECK(numSent == contents.size());
+
+    client.close();
+    waitUntil([&] { return closed; });
+
+    std::filesystem::remove(path);
+
+    // The file and pipes used for the send are closed through the event loop, so new sockets can take their
+    // descriptor numbers (the epoll backend would otherwise still think it is watching them)
+    // The connections are kept open so each one takes new descriptors, and each receive is started before the data is
+    // sent so it has to wait for its socket to be ready.
+    constexpr std::size_t numNext = 3;
+    std::array<ClientSocketIP, numNext> nextClients;
+    std::array<SocketPtr, numNext> nextAccepted;
+    std::array<std::string, numNext> nextReceived;
+    std::array<bool, numNext> nextClosed{};
+
+    for (std::size_t i = 0; i < numNext; i++) {
+        nextAccepted[i] = server.connect(nextClients[i]);
+        recvAll(*nextAccepted[i], nextReceived[i], nextClosed[i]);
+
+        runSync([&]() -> Task<> { co_await nextClients[i].send("data"); });
+        waitUntil([&] { return nextReceived[i].size() >= 4; });
+        CHECK(nextReceived[i] == "data");
+    }
+
+    for (auto& i : nextClients) i.close();
+    waitUntil([&] { return std::ranges::count(nextClosed, true) == static_cast<int>(numNext); });
+}
+
+// Sends back the data received until the connection is closed.
+Task<> echoAll(const Socket& socket, bool& closed) {
+    while (true) {
+        auto result = co_await socket.recv(1024);
+        if (result.closed) break;
+
+        co_await socket.send(result.data);
+    }
+
+    closed = true;
+}
+
+// Relays data between sockets, collecting the samples.
+Task<> relayAndSample(const Socket& source, const Socket& target, std::string& samples, bool& done) {
+    co_await source.relay(target, 4, [&samples](std::size_t size, std::string sample) {
+        CHECK(size >= sample.size());
+        samples += sample;
+    });
+    done = true;
+}
+
+TEST_CASE("Relay") {
+    LocalServer server;
+
+    // Connect two clients, data from the first one is relayed to the second one
+    std::array<ClientSocketIP, 2> clients;
+    std::vector<SocketPtr> accepted;
+    for (auto& i : clients) accepted.push_back(server.connect(i));
+
+    std::string samples;
+    bool done = false;
+    relayAndSample(*accepted[0], clients[1], samples, done);
+
+    std::string received;
+    bool closed = false;
+    recvAll(*accepted[1], received, closed);
+
+    const std::string data = "relayed data";
+    runSync([&]() -> Task<> { co_await clients[0].send(data); });
+
+    waitUntil([&] { return received.size() >= data.size(); });
+    CHECK(received == data);
+    CHECK(samples == data.substr(0, 4));
+
+    // Closing the first connection ends the relay and the second connection
+    clients[0].close();
+    waitUntil([&] { return done && closed; });
+
+    // The relay's pipes are closed through the event loop, so new sockets can take their descriptor numbers (the
+    // epoll backend would otherwise still think it is watching them). As in the "Send file" test, the connections are
+    // kept open so each one takes new descriptors. Data is echoed back so both ends wait for their sockets to be ready.
+    constexpr std::size_t numNext = 3;
+    std::array<ClientSocketIP, numNext> nextClients;
+    std::array<SocketPtr, numNext> nextAccepted;
+    std::array<bool, numNext> nextClosed{};
+
+    for (std::size_t i = 0; i < numNext; i++) {
+        nextAccepted[i] = server.connect(nextClients[i]);
+        echoAll(*nextAccepted[i], nextClosed[i]);
+
+        std::string response;
+        runSync([&]() -> Task<> {
+            co_await nextClients[i].send("data");
+            response = (co_await nextClients[i].recv(1024)).data;
+        });
+        CHECK(response == "data");
+    }
+
+    for (auto& i : nextClients) i.close();
+    waitUntil([&] { return std::ranges::count(nextClosed, true) == static_cast<int>(numNext); });
+}
+
+// Relays data until a stop is requested, checking that the relay is canceled.
+Task<> relayUntilStopped(const Socket& source, const Socket& target, std::stop_token stopToken, bool& stopped) {
+    try {
+        co_await source.relay(target, 0, [](std::size_t, std::string) {}, stopToken);
+    } catch (const System::SystemError& e) {
+        CHECK(e.isCanceled());
+    }
+    stopped = true;
+}
+
+TEST_CASE("Stop relay") {
+    LocalServer server;
+
+    std::array<ClientSocketIP, 2> clients;
+    std::vector<SocketPtr> accepted;
+    for (auto& i : clients) accepted.push_back(server.connect(i));
+
+    // Nothing is sent, so the relay only ends through its stop token (the sockets are left open)
+    std::stop_source stopSource;
+    bool stopped = false;
+    relayUntilStopped(*accepted[0], clients[1], stopSource.get_token(), stopped);
+
+    Async::handleEvents(false);
+    CHECK_FALSE(stopped);
+
+    stopSource.request_stop();
+    waitUntil([&] { return stopped; });
+}
+
+// Sends requests, receiving each response with a linked operation.
+Task<> sendRequests(const ClientSocketIP& client, std::vector<std::string>& responses) {
+    for (const char* request : { "first", "second", "third" })
+        responses.push_back((co_await client.sendRecv(request, 1024)).data);
+}
+
+TEST_CASE("Linked operations") {
+    LocalConnection local;
+    auto& [_, client, accepted] = local;
+
+    bool closed = false;
+    echoAll(*accepted, closed);
+
+    // Each request is sent and its response received with one submission
+    std::vector<std::string> responses;
+    sendRequests(client, responses);
+
+    waitUntil([&] { return responses.size() >= 3; });
+    CHECK(responses == std::vector<std::string>{ "first", "second", "third" });
+
+    // Closing links the shutdown to the close, the peer sees the end of the connection
+    client.close();
+    waitUntil([&] { return closed; });
+}
@@ -0,0 +1,40 @@
+// Copyright 2021-2024 Aidan Sun and the WhaleConnect contributors
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include <chrono>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "helpers/helpers.hpp"
+#include "helpers/testio.hpp"
+#include "os/async.hpp"
+#include "os/error.hpp"
+#include "sockets/clientsocket.hpp"
+#include "sockets/delegates/delegates.hpp"
+#include "utils/task.hpp"
+
+#if OS_LINUX
+TEST_CASE("Operation timeout") {
+    using namespace std::literals;
+
+    LocalConnection local;
+    auto& [_, client, accepted] = local;
+
+    // Nothing is sent, so the receive has to time out
+    client.setTimeout(100ms);
+
+    bool timedOut = false;
+    const auto start = std::chrono::steady_clock::now();
+    runSync([&]() -> Task<> {
+        try {
+            co_await client.recv(4);
+        } catch (const System::SystemError& e) {
+            CHECK_FALSE(e.isCanceled());
+            timedOut = e.isTimedOut();
+        }
+    });
+
+    CHECK(timedOut);
+    CHECK(std::chrono::steady_clock::now() - start >= 100ms);
+}
+#endif
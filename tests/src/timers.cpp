@@ -0,0 +1,123 @@
+// Copyright 2021-2024 Aidan Sun and the WhaleConnect contributors
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <stop_token>
+#include <thread>
+#include <vector>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "helpers/helpers.hpp"
+#include "os/async.hpp"
+#include "utils/task.hpp"
+#include "utils/timerwheel.hpp"
+
+TEST_CASE("Timer wheel") {
+    // Expiries go past the range of the wheel's highest level so timers are moved down from every level
+    constexpr std::size_t numTimers = 100000;
+    constexpr std::uint64_t maxExpiry = std::uint64_t{ 1 } << 25;
+
+    std::mt19937_64 rng{ 1 };
+    std::uniform_int_distribution<std::uint64_t> expiries{ 1, maxExpiry };
+    std::uniform_int_distribution<std::uint64_t> steps{ 1, 100000 };
+
+    TimerWheel wheel;
+    std::vector<TimerWheel::Timer> timers(numTimers);
+    for (auto& i : timers) {
+        i.expiry = expiries(rng);
+        wheel.add(i);
+    }
+
+    // Every other timer is disarmed
+    for (std::size_t i = 0; i < numTimers; i += 2) wheel.remove(timers[i]);
+    CHECK(wheel.size() == numTimers / 2);
+
+    // Timers fire in order, within the advance that reaches their expiries
+    std::size_t numFired = 0;
+    std::uint64_t lastExpiry = 0;
+    bool inOrder = true;
+    bool inTime = true;
+
+    for (std::uint64_t now = 0, prev = 0; !wheel.empty(); prev = now) {
+        now += steps(rng);
+        wheel.advance(now, [&](TimerWheel::Timer& timer) {
+            if (timer.expiry < lastExpiry) inOrder = false;
+            if (timer.expiry > now || timer.expiry <= prev) inTime = false;
+
+            lastExpiry = timer.expiry;
+            numFired++;
+        });
+    }
+
+    CHECK(numFired == numTimers / 2);
+    CHECK(inOrder);
+    CHECK(inTime);
+}
+
+// Sleeps for a number of time units, then records the number.
+Task<> sleepAndRecord(std::vector<int>& order, int units) {
+    using namespace std::literals;
+
+    co_await Async::sleep(units * 20ms);
+    order.push_back(units);
+}
+
+// Counts the ticks of a periodic timer.
+Task<> countTicks(int& numTicks, int maxTicks) {
+    using namespace std::literals;
+
+    Async::PeriodicTimer timer{ 10ms };
+    while (numTicks < maxTicks) {
+        co_await timer.tick();
+        numTicks++;
+    }
+}
+
+TEST_CASE("Sleep and periodic timers") {
+    using namespace std::literals;
+
+    const auto start = std::chrono::steady_clock::now();
+
+    // Sleeps resume after their durations, in order
+    std::vector<int> order;
+    for (int i : { 3, 1, 2 }) sleepAndRecord(order, i);
+
+    // A periodic timer keeps its schedule
+    int numTicks = 0;
+    countTicks(numTicks, 5);
+
+    waitUntil([&] { return order.size() >= 3 && numTicks >= 5; });
+
+    CHECK(order == std::vector{ 1, 2, 3 });
+    CHECK(std::chrono::steady_clock::now() - start >= 60ms);
+    CHECK(Async::currentEventLoop().size() == 0);
+}
+
+// Sleeps until a stop is requested, then records that it finished.
+Task<> sleepUntilStopped(bool& done, std::stop_token stopToken) {
+    using namespace std::literals;
+
+    co_await Async::sleep(10s, stopToken);
+    done = true;
+}
+
+TEST_CASE("Stop sleep from another thread") {
+    using namespace std::literals;
+
+    const auto start = std::chrono::steady_clock::now();
+
+    // The sleep is resumed by its own event loop when the stop is requested elsewhere
+    std::stop_source stopSource;
+    bool done = false;
+    sleepUntilStopped(done, stopSource.get_token());
+
+    std::thread{ [&] { stopSource.request_stop(); } }.join();
+    waitUntil([&] { return done; });
+
+    CHECK(std::chrono::steady_clock::now() - start < 5s);
+    CHECK(Async::currentEventLoop().size() == 0);
+}
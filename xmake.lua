@@ -95,8 +95,8 @@ target("core")
     end
 
     add_files(
-        "src/net/netutils.cpp",
-        "src/os/async.cpp", "src/os/error.cpp",
+        "src/net/netutils.cpp", "src/net/resolver.cpp",
+        "src/os/async.cpp", "src/os/error.cpp", "src/os/filewriter.cpp",
         "src/sockets/delegates/secure/*.cpp",
         "src/utils/*.cpp"
     )
@@ -119,6 +119,7 @@ target("core")
     elseif is_plat("linux") then
         add_files(
             "src/net/btutils.linux.cpp",
+            "src/os/async.epoll.cpp",
             "src/os/async.linux.cpp",
             "src/sockets/delegates/linux/*.cpp"
         )